@@ -0,0 +1,124 @@
+// Arena.c ... implementation of Arena (bulk memory allocator) ADT
+// Memory is carved sequentially out of large blocks; allocation is a
+// pointer bump, and dropArena frees one block per ~64KiB handed out.
+// An Arena is not thread-safe: use one Arena per thread, and combine
+// them with ArenaAdopt afterwards.
+
+#include <assert.h>
+#include <err.h>
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <sysexits.h>
+
+#include "Arena.h"
+
+#define BLOCK_SIZE (64 * 1024)
+#define ALIGN (alignof (max_align_t))
+
+// data structures representing Arena
+
+typedef struct ArenaBlock *Block;
+
+typedef struct ArenaBlock {
+	Block next;		 // previously filled block
+	max_align_t data[]; // start of usable memory
+} ArenaBlock;
+
+typedef struct ArenaRep {
+	Block blocks;	// most recent block (head of block list)
+	char *free;		// next free byte in most recent block
+	size_t left;	// number of free bytes in most recent block
+} ArenaRep;
+
+static Block newBlock (size_t size);
+
+// create a new empty Arena
+Arena newArena (void)
+{
+	ArenaRep *new = malloc (sizeof *new);
+	if (new == NULL) err (EX_OSERR, "couldn't allocate Arena");
+	*new = (ArenaRep) { };
+	return new;
+}
+
+// free up all memory allocated from Arena
+void dropArena (Arena a)
+{
+	assert (a != NULL);
+	Block curr = a->blocks;
+	while (curr != NULL) {
+		Block next = curr->next;
+		free (curr);
+		curr = next;
+	}
+	free (a);
+}
+
+// allocate (uninitialised, suitably aligned) memory from Arena
+// if Arena is NULL, memory comes from malloc (and must be free'd)
+void *ArenaAlloc (Arena a, size_t size)
+{
+	if (a == NULL) {
+		void *mem = malloc (size);
+		if (mem == NULL) err (EX_OSERR, "couldn't allocate memory");
+		return mem;
+	}
+
+	size = (size + ALIGN - 1) & ~(ALIGN - 1);
+	if (size > a->left) {
+		// big objects get a block of their own, behind the current one
+		// (or as the only block, leaving no free space, if there's none)
+		if (size > BLOCK_SIZE / 4) {
+			Block b = newBlock (size);
+			if (a->blocks == NULL) {
+				b->next = NULL;
+				a->blocks = b;
+			} else {
+				b->next = a->blocks->next;
+				a->blocks->next = b;
+			}
+			return b->data;
+		}
+		Block b = newBlock (BLOCK_SIZE);
+		b->next = a->blocks;
+		a->blocks = b;
+		a->free = (char *) b->data;
+		a->left = BLOCK_SIZE;
+	}
+	void *mem = a->free;
+	a->free += size;
+	a->left -= size;
+	return mem;
+}
+
+// move all memory allocated from 2nd Arena into 1st Arena
+// the adopted blocks go behind the 1st Arena's current block,
+// so the free space in that block can still be used
+void ArenaAdopt (Arena a, Arena from)
+{
+	assert (a != NULL && from != NULL);
+	if (from->blocks != NULL) {
+		Block tail = from->blocks;
+		while (tail->next != NULL)
+			tail = tail->next;
+		if (a->blocks == NULL) {
+			tail->next = NULL;
+			a->blocks = from->blocks;
+			// (no free space: next ArenaAlloc starts a new block)
+		} else {
+			tail->next = a->blocks->next;
+			a->blocks->next = from->blocks;
+		}
+	}
+	free (from);
+}
+
+// allocate a block with at least size bytes of usable memory
+// (this function is used only within the ADT)
+static Block newBlock (size_t size)
+{
+	Block b = malloc (sizeof *b + size);
+	if (b == NULL) err (EX_OSERR, "couldn't allocate Arena block");
+	return b;
+}
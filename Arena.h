@@ -0,0 +1,28 @@
+// Arena.h ... interface to Arena (bulk memory allocator) ADT
+// Objects allocated from an Arena are never freed individually;
+// they are all released together by dropArena.
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// External view of Arena
+
+typedef struct ArenaRep *Arena;
+
+// create a new empty Arena
+Arena newArena (void);
+
+// free up all memory allocated from Arena
+void dropArena (Arena);
+
+// allocate (uninitialised, suitably aligned) memory from Arena
+// if Arena is NULL, memory comes from malloc (and must be free'd)
+void *ArenaAlloc (Arena, size_t);
+
+// move all memory allocated from 2nd Arena into 1st Arena
+// (the 2nd Arena is dropped, but its allocations remain valid)
+void ArenaAdopt (Arena, Arena);
+
+#endif
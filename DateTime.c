@@ -6,6 +6,7 @@
 #endif
 
 #include <assert.h>
+#include <ctype.h>
 #include <err.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -14,13 +15,17 @@
 #include <sysexits.h>
 #include <time.h>
 
+#include "Arena.h"
 #include "DateTime.h"
 
-// data structures to represent DateTime (timestamp) values
+// DateTimeRep (a Timestamp plus its zone) is defined in DateTime.h
 
-typedef struct DateTimeRep {
-	time_t timestamp;
-} DateTimeRep;
+static bool scanRFC5322 (const char *str, Timestamp *stamp, int *zone);
+static bool scanNumber (const char **s, int min, int max, int *val);
+static bool scanZone (const char **s, int *offset);
+static int monthNumber (const char *s);
+static int64_t daysFromCivil (int y, int m, int d);
+static void civilFromDays (int64_t days, int *y, int *m, int *d);
 
 // create new timestamp object
 // only needed if you want to build the timestamp yourself
@@ -29,10 +34,8 @@ DateTime newDateTime ()
 {
 	DateTimeRep *new = malloc (sizeof *new);
 	if (new == NULL) err (EX_OSERR, "couldn't allocate DateTime");
-
-	struct tm epoch;
-	strptime ("1970-01-01 00:00:00", "%F %T", &epoch);
-	new->timestamp = mktime (&epoch);
+	new->timestamp = 0; // 1970-01-01 00:00:00 UTC
+	new->zone = 0;
 	return new;
 }
 
@@ -49,6 +52,34 @@ void dropDateTime (DateTime dt)
 //   27 April 2011 9:48:28 AM   == "%e %B %Y %r"
 DateTime scanDateTime (char *str)
 {
+	return scanDateTimeIn (str, NULL);
+}
+
+// as for scanDateTime, but allocate timestamp from an Arena
+// (a NULL Arena means use malloc, as for newDateTime)
+DateTime scanDateTimeIn (char *str, Arena arena)
+{
+	DateTimeRep value;
+	if (! scanDateTimeInto (str, &value))
+		return NULL;
+
+	DateTimeRep *new = ArenaAlloc (arena, sizeof *new);
+	*new = value;
+	return new;
+}
+
+// convert a string into an existing DateTime
+// return false (and leave DateTime alone) if string can't be parsed
+// RFC 5322 dates (which is what almost all Date: headers contain)
+// are parsed in one pass, honouring their zone offset; anything else
+// falls back to the older strptime formats, which carry no zone and
+// are taken as UTC (mktime would make the result depend on TZ)
+bool scanDateTimeInto (char *str, DateTime dt)
+{
+	assert (dt != NULL);
+	if (scanRFC5322 (str, &dt->timestamp, &dt->zone))
+		return true;
+
 	struct tm time;
 	char *result;
 
@@ -66,18 +97,179 @@ DateTime scanDateTime (char *str)
 
 	// if fails again, give up
 	if (result == NULL)
-		return NULL;
+		return false;
 
-	DateTime new = newDateTime ();
-	new->timestamp = mktime (&time);
-	return new;
+	dt->timestamp = daysFromCivil (time.tm_year + 1900, time.tm_mon + 1,
+		time.tm_mday) * 86400
+		+ time.tm_hour * 3600 + time.tm_min * 60 + time.tm_sec;
+	dt->zone = 0;
+	return true;
+}
+
+// parse an RFC 5322 date-time, computing seconds since the epoch
+// arithmetically, allowing for the zone offset:
+//   [ day-of-week "," ] day month year hour ":" min [ ":" sec ] zone
+// e.g. "Wed, 3 Apr 2013 12:18:09 +1100"; anything after the zone
+// (typically a comment such as "(EST)") is ignored
+static bool scanRFC5322 (const char *s, Timestamp *stamp, int *zone)
+{
+	int day, month, year, hour, min, sec = 0, offset;
+
+	while (*s == ' ' || *s == '\t') s++;
+	// optional day-of-week (not checked against the date)
+	if (isalpha ((unsigned char) *s)) {
+		while (isalpha ((unsigned char) *s)) s++;
+		if (*s++ != ',') return false;
+	}
+	if (! scanNumber (&s, 1, 31, &day)) return false;
+
+	while (*s == ' ') s++;
+	if ((month = monthNumber (s)) == 0) return false;
+	while (isalpha ((unsigned char) *s)) s++;
+
+	const char *digits = s;
+	if (! scanNumber (&s, 0, 9999, &year)) return false;
+	while (*digits == ' ' || *digits == '\t') digits++;
+	if (s - digits == 2) // obsolete 2-digit years
+		year += (year < 50) ? 2000 : 1900;
+	else if (s - digits == 3)
+		year += 1900;
+
+	if (! scanNumber (&s, 0, 23, &hour)) return false;
+	if (*s++ != ':') return false;
+	if (! scanNumber (&s, 0, 59, &min)) return false;
+	if (*s == ':') {
+		s++;
+		if (! scanNumber (&s, 0, 60, &sec)) return false;
+	}
+	if (! scanZone (&s, &offset)) return false;
+
+	*stamp = daysFromCivil (year, month, day) * 86400
+		+ hour * 3600 + min * 60 + sec - offset;
+	*zone = offset;
+	return true;
+}
+
+// skip blanks, then read an unsigned decimal number in [min..max]
+static bool scanNumber (const char **s, int min, int max, int *val)
+{
+	const char *p = *s;
+	while (*p == ' ' || *p == '\t') p++;
+	if (! isdigit ((unsigned char) *p)) return false;
+	int n = 0;
+	while (isdigit ((unsigned char) *p) && n <= max)
+		n = 10 * n + (*p++ - '0');
+	if (n < min || n > max) return false;
+	*s = p;
+	*val = n;
+	return true;
+}
+
+// read a zone: "+hhmm", "-hhmm", or an obsolete zone name
+// sets *offset to the zone's offset from UTC in seconds
+static bool scanZone (const char **s, int *offset)
+{
+	static const struct { const char *name; int hours; } zones[] = {
+		{ "UT", 0 }, { "GMT", 0 }, { "Z", 0 },
+		{ "EST", -5 }, { "EDT", -4 }, { "CST", -6 }, { "CDT", -5 },
+		{ "MST", -7 }, { "MDT", -6 }, { "PST", -8 }, { "PDT", -7 },
+	};
+	const char *p = *s;
+	while (*p == ' ' || *p == '\t') p++;
+
+	if (*p == '+' || *p == '-') {
+		int sign = (*p == '-') ? -1 : 1;
+		p++;
+		for (int i = 0; i < 4; i++)
+			if (! isdigit ((unsigned char) p[i])) return false;
+		int hh = (p[0] - '0') * 10 + (p[1] - '0');
+		int mm = (p[2] - '0') * 10 + (p[3] - '0');
+		if (mm > 59) return false;
+		*offset = sign * (hh * 3600 + mm * 60);
+		*s = p + 4;
+		return true;
+	}
+	for (size_t i = 0; i < sizeof zones / sizeof zones[0]; i++) {
+		size_t len = strlen (zones[i].name);
+		if (strncasecmp (p, zones[i].name, len) == 0 &&
+				! isalpha ((unsigned char) p[len])) {
+			*offset = zones[i].hours * 3600;
+			*s = p + len;
+			return true;
+		}
+	}
+	return false;
+}
+
+// month number (1..12) from three-letter English name, 0 if none
+static int monthNumber (const char *s)
+{
+	static const char names[] = "janfebmaraprmayjunjulaugsepoctnovdec";
+	char m[3];
+	for (int i = 0; i < 3; i++) {
+		if (! isalpha ((unsigned char) s[i])) return 0;
+		m[i] = (char) tolower ((unsigned char) s[i]);
+	}
+	for (int i = 0; i < 12; i++)
+		if (strncmp (&names[3 * i], m, 3) == 0)
+			return i + 1;
+	return 0;
+}
+
+// number of days from 1970-01-01 to y-m-d (proleptic Gregorian)
+// (H. Hinnant's days_from_civil algorithm)
+static int64_t daysFromCivil (int y, int m, int d)
+{
+	y -= (m <= 2);
+	int64_t era = (y >= 0 ? y : y - 399) / 400;
+	int64_t yoe = y - era * 400;
+	int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+// inverse of daysFromCivil (H. Hinnant's civil_from_days algorithm)
+static void civilFromDays (int64_t days, int *y, int *m, int *d)
+{
+	days += 719468;
+	int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+	int64_t doe = days - era * 146097;
+	int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	int64_t mp = (5 * doy + 2) / 153;
+	*d = (int) (doy - (153 * mp + 2) / 5 + 1);
+	*m = (int) (mp < 10 ? mp + 3 : mp - 9);
+	*y = (int) (yoe + era * 400 + (*m <= 2));
 }
 
 // print formatted DateTime value to stdout
+// (in the zone it was written in, so output doesn't depend on TZ)
 void showDateTime (DateTime dt)
 {
 	assert (dt != NULL);
-	printf ("%s", ctime (&(dt->timestamp)));
+	char buf[DATETIME_LEN];
+	showDateTimeTo (buf, sizeof buf, dt, dt->zone);
+	fputs (buf, stdout);
+}
+
+// format DateTime into a buffer, in the given zone, as snprintf
+// same format as ctime, e.g. "Wed Apr  3 12:18:09 2013\n"
+int showDateTimeTo (char *buf, size_t size, DateTime dt, int zone)
+{
+	static const char days[] = "ThuFriSatSunMonTueWed"; // 1970-01-01 = Thu
+	static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+	assert (dt != NULL);
+
+	Timestamp local = dt->timestamp + zone;
+	int64_t day = (local >= 0) ? local / 86400 : (local - 86399) / 86400;
+	int secs = (int) (local - day * 86400);
+	int y, m, d;
+	civilFromDays (day, &y, &m, &d);
+	int wday = (int) (((day % 7) + 7) % 7);
+
+	return snprintf (buf, size, "%.3s %.3s%3d %.2d:%.2d:%.2d %d\n",
+		&days[3 * wday], &months[3 * (m - 1)], d,
+		secs / 3600, secs / 60 % 60, secs % 60, y);
 }
 
 // check whether one timestamp precedes another
@@ -85,8 +277,7 @@ bool DateTimeBefore (DateTime dt1, DateTime dt2)
 {
 	assert (dt1 != NULL);
 	assert (dt2 != NULL);
-	double diff = difftime (dt1->timestamp, dt2->timestamp);
-	return (diff < 0.0) ? 1 : 0;
+	return TimestampBefore (dt1->timestamp, dt2->timestamp);
 }
 
 // check whether one timestamp follows another
@@ -94,6 +285,5 @@ bool DateTimeAfter (DateTime dt1, DateTime dt2)
 {
 	assert (dt1 != NULL);
 	assert (dt2 != NULL);
-	double diff = difftime (dt1->timestamp, dt2->timestamp);
-	return (diff > 0.0) ? 1 : 0;
+	return TimestampAfter (dt1->timestamp, dt2->timestamp);
 }
@@ -5,11 +5,46 @@
 #define DATE_TIME_H
 
 #include <stdbool.h>
+#include <stdint.h>
+
+#include "Arena.h"
+
+// Timestamp: a date/time as a plain integer value
+// (seconds since the epoch, UTC); cheap to store inline and compare
+// Times are never interpreted in the host's local time zone, so
+// results don't depend on TZ and parsing is safe in any thread.
+
+typedef int64_t Timestamp;
+
+// check whether one Timestamp precedes/follows another
+static inline bool TimestampBefore (Timestamp t1, Timestamp t2)
+{
+	return t1 < t2;
+}
+
+static inline bool TimestampAfter (Timestamp t1, Timestamp t2)
+{
+	return t1 > t2;
+}
 
 // External view of DateTime
+// (the original opaque-pointer API, now a thin layer over Timestamp;
+// the representation is visible only so that it can be embedded by
+// value in other structures, e.g. MailMessage)
+
+typedef struct DateTimeRep {
+	Timestamp timestamp; // when (UTC)
+	int zone;			 // zone it was written in (seconds east of UTC)
+} DateTimeRep;
 
 typedef struct DateTimeRep* DateTime;
 
+// get Timestamp value of DateTime
+static inline Timestamp DateTimeStamp (DateTime dt)
+{
+	return dt->timestamp;
+}
+
 // create new timestamp object
 DateTime newDateTime (void);
 
@@ -19,9 +54,22 @@ void dropDateTime (DateTime);
 // convert a string into a timestamp value
 DateTime scanDateTime (char *);
 
-// write DateTime to stdout
+// as for scanDateTime, but allocate timestamp from an Arena
+DateTime scanDateTimeIn (char *, Arena);
+
+// convert a string into an existing DateTime (e.g. an embedded one)
+// return false (and leave DateTime alone) if string can't be parsed
+bool scanDateTimeInto (char *, DateTime);
+
+// write DateTime to stdout (in the zone it was written in)
 void showDateTime (DateTime);
 
+// format DateTime into a buffer, in the zone given, as snprintf
+// (reentrant replacement for ctime: same text, but no static buffer)
+// DATETIME_LEN bytes are always enough
+#define DATETIME_LEN 64
+int showDateTimeTo (char *, size_t, DateTime, int);
+
 // check whether one timestamp precedes another
 bool DateTimeBefore (DateTime, DateTime);
 
@@ -0,0 +1,24 @@
+// Hash.h ... hashing of byte strings
+// One hash function (FNV-1a) for the hash tables of Message-IDs
+// (IDTable, MMTreeHash) and for the MailBox index's checksums (of
+// its entries, and of a sample of the mailbox).
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// FNV-1a hash of len bytes
+static inline uint64_t hashBytes (const void *data, size_t len)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	const unsigned char *c = data;
+	for (size_t i = 0; i < len; i++) {
+		hash ^= c[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+#endif
@@ -0,0 +1,125 @@
+// IDTable.c ... implementation of Message-ID interning table ADT
+// Handles index two parallel arrays holding each ID and its hash; a
+// separate open-addressing hash table (linear probing) of handles is
+// used to find the handle for a string.
+
+#include <assert.h>
+#include <err.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+
+#include "Hash.h"
+#include "IDTable.h"
+
+// data structures representing IDTable
+
+typedef struct IDTableRep {
+	char **names;	 // ID for each handle (names[0] unused)
+	uint64_t *hashes; // hash of ID for each handle
+	size_t count;	 // number of handles given out
+	size_t max;	 // size of names and hashes arrays
+	MsgID *slots;	 // hash table of handles (NO_MSGID = empty)
+	size_t nslots;	 // size of hash table (power of 2)
+} IDTableRep;
+
+#define MIN_SLOTS 64
+
+static void growSlots (IDTable t);
+
+// create a new empty IDTable
+IDTable newIDTable (void)
+{
+	IDTableRep *new = malloc (sizeof *new);
+	if (new == NULL) err (EX_OSERR, "couldn't allocate IDTable");
+	*new = (IDTableRep) { .max = MIN_SLOTS / 2, .nslots = MIN_SLOTS };
+	new->names = malloc (new->max * sizeof *new->names);
+	new->hashes = malloc (new->max * sizeof *new->hashes);
+	new->slots = calloc (new->nslots, sizeof *new->slots);
+	if (new->names == NULL || new->hashes == NULL || new->slots == NULL)
+		err (EX_OSERR, "couldn't allocate IDTable");
+	new->names[0] = NULL;
+	return new;
+}
+
+// free memory associated with IDTable
+void dropIDTable (IDTable t)
+{
+	assert (t != NULL);
+	free (t->names);
+	free (t->hashes);
+	free (t->slots);
+	free (t);
+}
+
+// return the handle for an ID, interning it if necessary
+MsgID IDTableIntern (IDTable t, char *id)
+{
+	assert (t != NULL);
+	if (id == NULL)
+		return NO_MSGID;
+
+	uint64_t hash = hashBytes (id, strlen (id));
+	size_t mask = t->nslots - 1;
+	size_t i = (size_t) hash & mask;
+	for (; t->slots[i] != NO_MSGID; i = (i + 1) & mask) {
+		MsgID h = t->slots[i];
+		if (t->hashes[h] == hash && strcmp (t->names[h], id) == 0)
+			return h;
+	}
+
+	// a new ID: give it the next handle
+	if (t->count + 1 >= UINT32_MAX)
+		errx (EX_SOFTWARE, "too many Message-IDs");
+	MsgID h = (MsgID) ++t->count;
+	if (h >= t->max) {
+		t->max *= 2;
+		t->names = realloc (t->names, t->max * sizeof *t->names);
+		t->hashes = realloc (t->hashes, t->max * sizeof *t->hashes);
+		if (t->names == NULL || t->hashes == NULL)
+			err (EX_OSERR, "couldn't allocate IDTable");
+	}
+	t->names[h] = id;
+	t->hashes[h] = hash;
+	t->slots[i] = h;
+
+	// more than half the slots in use: double them
+	if (2 * t->count > t->nslots)
+		growSlots (t);
+	return h;
+}
+
+// return the ID string that a handle stands for
+char *IDTableName (IDTable t, MsgID h)
+{
+	assert (t != NULL && h <= t->count);
+	return t->names[h];
+}
+
+// number of handles given out so far
+size_t IDTableSize (IDTable t)
+{
+	assert (t != NULL);
+	return t->count;
+}
+
+// double size of hash table, re-inserting all handles
+// (each handle's slot comes from its entry in hashes, so no ID
+// string is looked at)
+// (this function is used only within the ADT)
+static void growSlots (IDTable t)
+{
+	free (t->slots);
+	t->nslots *= 2;
+	t->slots = calloc (t->nslots, sizeof *t->slots);
+	if (t->slots == NULL) err (EX_OSERR, "couldn't allocate IDTable");
+
+	size_t mask = t->nslots - 1;
+	for (size_t h = 1; h <= t->count; h++) {
+		size_t i = (size_t) t->hashes[h] & mask;
+		while (t->slots[i] != NO_MSGID)
+			i = (i + 1) & mask;
+		t->slots[i] = (MsgID) h;
+	}
+}
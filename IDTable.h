@@ -0,0 +1,39 @@
+// IDTable.h ... interface to Message-ID interning table ADT
+// Each distinct Message-ID string is stored once, and is represented
+// by a small integer handle (MsgID), so IDs can be compared with ==
+// and used directly as array indexes.
+
+#ifndef IDTABLE_H
+#define IDTABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// External view of IDTable
+
+typedef struct IDTableRep *IDTable;
+
+// handles are numbered 1, 2, 3, ... in the order IDs are interned
+typedef uint32_t MsgID;
+#define NO_MSGID 0	// handle for a missing (NULL) ID
+
+// create a new empty IDTable
+IDTable newIDTable (void);
+
+// free memory associated with IDTable
+// note: does not free the ID strings themselves
+void dropIDTable (IDTable);
+
+// return the handle for an ID, giving it a new one if it's not
+// already in the table (NO_MSGID if the ID is NULL)
+// the string is not copied: it must outlive the table
+MsgID IDTableIntern (IDTable, char *);
+
+// return the ID string that a handle stands for
+char *IDTableName (IDTable, MsgID);
+
+// number of handles given out so far
+// (all handles are less than or equal to this)
+size_t IDTableSize (IDTable);
+
+#endif
@@ -9,36 +9,70 @@
 #include <string.h>
 #include <sysexits.h>
 
+#include "Arena.h"
 #include "MMList.h"
 #include "MailMessage.h"
+#include "OutBuf.h"
+#include "Stats.h"
+
+// Compile with -DMMLIST_VALIDATE (e.g. make CPPFLAGS=-DMMLIST_VALIDATE)
+// to re-check the whole list after every change; this is O(n) per
+// insert, so normal builds only check the insertion point.
 
 // data structures representing MMList
+// The list is a skip list ordered on MailMessageTimestamp: level 0
+// links every node in order (this is the list that is iterated),
+// and each higher level links a random subset of the level below,
+// so finding the insertion point takes O(log n) expected steps.
+
+#define MAX_LEVEL 32 // enough for 2^32 messages at p = 1/2
 
 typedef struct MMListNode* Link;
 
 typedef struct MMListNode {
 	MailMessage data; // message associated with this list item
-	Link next;		  // pointer to node containing next element
+	Timestamp key;	  // timestamp of message (copied, for fast compares)
+	int height;		  // number of levels this node is linked into
+	Link next[];	  // next node at each level (next[0] is in order)
 } MMListNode;
 
+// (message, timestamp) pair, for sorting in MMListFinalize
+typedef struct MMListItem {
+	Timestamp key;
+	MailMessage data;
+} Item;
+
 typedef struct MMListRep {
-	Link first; // node containing first value
-	Link last;  // node containing last value
+	Link head[MAX_LEVEL]; // first node at each level
 	Link curr;  // current node (for iteration)
+	int levels; // number of levels in use
+	unsigned int seed; // state of random level generator
+	Item *pending; // messages waiting for MMListFinalize
+	size_t npending, maxpending;
+	Arena arena; // where nodes come from (NULL = malloc)
 } MMListRep;
 
-static Link newMMListNode (MailMessage mesg);
-
-//Helper functions for Inserting into MMList
-static void MMListInsertBefore(MMList L, Link curr, Link n);
-static void MMListInsertAfter(MMList L, Link curr, Link n);
+static Link newMMListNode (MMList L, Item item, int height);
+static void dropMMListNodes (MMList L);
+static int randomLevel (MMList L);
+static size_t sortItems (Item *items, Item *tmp, size_t n);
+static void rebuildMMList (MMList L, Item *items, size_t n);
+#ifdef MMLIST_VALIDATE
+static bool MMListIsValid (MMList L);
+#endif
 
 // create a new empty MMList
 MMList newMMList (void)
 {
-	MMListRep *new = malloc (sizeof *new);
-	if (new == NULL) err (EX_OSERR, "couldn't allocate MMList");
-	*new = (MMListRep) { };
+	return newMMListIn (NULL);
+}
+
+// create a new empty MMList whose nodes come from an Arena
+// (a NULL Arena means use malloc)
+MMList newMMListIn (Arena arena)
+{
+	MMListRep *new = ArenaAlloc (arena, sizeof *new);
+	*new = (MMListRep) { .levels = 1, .seed = 2521, .arena = arena };
 	return new;
 }
 
@@ -47,123 +81,296 @@ MMList newMMList (void)
 void dropMMList (MMList L)
 {
 	assert (L != NULL);
-	Link curr = L->first;
+	free (L->pending);
+	if (L->arena != NULL)
+		return; // nodes are released with the Arena
+	dropMMListNodes (L);
+	free (L);
+}
+
+// free all nodes of a (malloc'd) list
+// (this function is used only within the ADT)
+static void dropMMListNodes (MMList L)
+{
+	Link curr = L->head[0];
 	while (curr != NULL) {
-		Link next = curr->next;
+		Link next = curr->next[0];
 		free (curr);
 		curr = next;
 	}
-	free (L);
 }
 
 // display list as one integer per line on stdout
 void showMMList (MMList L)
 {
 	assert (L != NULL);
-	for (Link curr = L->first; curr != NULL; curr = curr->next)
-		showMailMessage (curr->data, 0);
-}
-
-//the only time MMListInsertBefore is called is inserting before first element in the list
-static void MMListInsertBefore(MMList L, Link curr, Link n){
-	//inserting before the first element
-	n->next = L->first;
-	L->first = n;
-}
-
-static void MMListInsertAfter(MMList L, Link curr, Link n){
-	if(L->curr == L->last){
-		//inserting after the last element 
-		L->curr->next = n;
-		L->last = n;
-		n->next = NULL;
-	}else{
-		//inserting in the middle
-		//printf("Inserting in the middle\n");
-		n->next = curr->next;
-		curr->next = n;
-		
-	}
+	OutBuf out = newOutBuf (stdout);
+	for (Link curr = L->head[0]; curr != NULL; curr = curr->next[0])
+		showMailMessageOn (out, curr->data, 0);
+	dropOutBuf (out);
 }
 
 // insert mail message in order
-// ordering based on MailMessageDateTime
+// ordering based on MailMessageTimestamp
+// inserts before any older messages with the same timestamp
 void MMListInsert (MMList L, MailMessage mesg)
 {
 	assert (L != NULL);
-	assert (MMListIsOrdered (L));
+	assert (mesg != NULL);
 
+	Item item = { .key = MailMessageTimestamp (mesg), .data = mesg };
+
+	// find the last node before the insertion point on each level
+	// (NULL means the insertion point is at the head of that level)
+	Link update[MAX_LEVEL];
+	Link prev = NULL;
+	unsigned long long steps = 0;
+	for (int level = L->levels - 1; level >= 0; level--) {
+		Link next = (prev == NULL) ? L->head[level] : prev->next[level];
+		while (next != NULL && TimestampBefore (next->key, item.key)) {
+			prev = next;
+			next = next->next[level];
+			steps++;
+		}
+		update[level] = prev;
+	}
+	StatsCount (ST_LIST_INSERTS, 1);
+	StatsCount (ST_LIST_STEPS, steps);
+
+	// link new node in after the update nodes
+	int height = randomLevel (L);
+	for (; L->levels < height; L->levels++)
+		update[L->levels] = NULL;
+	Link newLink = newMMListNode (L, item, height);
+	for (int level = 0; level < height; level++) {
+		Link *pred = (update[level] == NULL) ?
+			&L->head[level] : &update[level]->next[level];
+		newLink->next[level] = *pred;
+		*pred = newLink;
+	}
+
+	// the list stays ordered if the new node fits its neighbours
+	assert (update[0] == NULL ||
+		! TimestampAfter (update[0]->key, item.key));
+	assert (newLink->next[0] == NULL ||
+		! TimestampAfter (item.key, newLink->next[0]->key));
+#ifdef MMLIST_VALIDATE
+	assert (MMListIsValid (L));
+#endif
+}
+
+// add mail message to list, without putting it in order yet
+void MMListAppendUnordered (MMList L, MailMessage mesg)
+{
+	assert (L != NULL);
 	assert (mesg != NULL);
 
-	//Create a new node
-	Link newLink = newMMListNode(mesg);
+	if (L->npending == L->maxpending) {
+		L->maxpending = (L->maxpending == 0) ? 64 : 2 * L->maxpending;
+		L->pending = realloc (L->pending,
+			L->maxpending * sizeof *L->pending);
+		if (L->pending == NULL)
+			err (EX_OSERR, "couldn't allocate MMList pending array");
+	}
+	L->pending[L->npending++] =
+		(Item) { .key = MailMessageTimestamp (mesg), .data = mesg };
+}
 
-	if(L->first == NULL){
-		//empty list
-		L->first = L->last = newLink;
-		newLink->next = NULL;
+// put all messages added by MMListAppendUnordered in order
+// pending messages are sorted, merged with the messages already in
+// the list, and the skip list is rebuilt from the merged sequence;
+// a message goes before any older message with the same timestamp
+void MMListFinalize (MMList L)
+{
+	assert (L != NULL);
+	if (L->npending == 0)
 		return;
+
+	size_t nold = 0;
+	for (Link curr = L->head[0]; curr != NULL; curr = curr->next[0])
+		nold++;
+	size_t n = nold + L->npending;
+	Item *all = malloc (2 * n * sizeof *all);
+	if (all == NULL) err (EX_OSERR, "couldn't allocate MMList sort array");
+	Item *tmp = all + n;
+
+	// pending messages, newest first, so a stable sort keeps
+	// newer messages ahead of older ones with the same timestamp
+	for (size_t i = 0; i < L->npending; i++)
+		all[nold + i] = L->pending[L->npending - 1 - i];
+	size_t steps = sortItems (&all[nold], tmp, L->npending);
+
+	// merge with the list contents (which are all older)
+	size_t i = 0, j = nold, k = 0;
+	for (Link curr = L->head[0]; curr != NULL; curr = curr->next[0])
+		tmp[k++] = (Item) { .key = curr->key, .data = curr->data };
+	k = 0;
+	while (i < nold && j < n) {
+		if (TimestampBefore (tmp[i].key, all[j].key))
+			all[k++] = tmp[i++];
+		else
+			all[k++] = all[j++];
+		steps++;
 	}
+	while (i < nold)
+		all[k++] = tmp[i++];
+	StatsCount (ST_LIST_INSERTS, L->npending);
+	StatsCount (ST_LIST_STEPS, steps);
+
+	rebuildMMList (L, all, n);
+	free (all);
+
+	free (L->pending);
+	L->pending = NULL;
+	L->npending = L->maxpending = 0;
+#ifdef MMLIST_VALIDATE
+	assert (MMListIsValid (L));
+#endif
+}
+
+// stable merge sort of an array of items by timestamp
+// (tmp is scratch space for n items)
+// returns the number of keys compared
+// (this function is used only within the ADT)
+static size_t sortItems (Item *items, Item *tmp, size_t n)
+{
+	if (n < 2)
+		return 0;
+	size_t mid = n / 2;
+	size_t steps = sortItems (items, tmp, mid);
+	steps += sortItems (&items[mid], tmp, n - mid) + 1;
 
-	//Getting Timestamps
-	DateTime firstDate =  MailMessageDateTime(L->first->data);
-	DateTime lastDate =  MailMessageDateTime(L->last->data);
-	DateTime newNodeDate = MailMessageDateTime(mesg);
-
-	if(DateTimeBefore(newNodeDate, firstDate)){
-		//insert newLink at the beginning
-		//printf("Inserting newLink at the beginning\n");
-		MMListInsertBefore(L,L->first, newLink);
-	}else if(DateTimeAfter(newNodeDate, lastDate)){
-		//insert newLink at the end
-		//printf("Inserting newLink at the end\n");
-		L->curr = L->last;
-		MMListInsertAfter(L,L->last, newLink);
-	}else{
-		//insertion in the middle
-		//inserts before the old msg if timestamps are same
-		//printf("Inserting newLink in the middle\n");
-		L->curr = L->first;
-		DateTime currNextDate = MailMessageDateTime(L->curr->next->data);
-
-		while(L->curr != NULL && L->curr->next != NULL && DateTimeAfter(newNodeDate,currNextDate)){
-			L->curr = L->curr->next;
-			currNextDate = MailMessageDateTime(L->curr->next->data);
-		}	
-		//insert after curr
-	
-		MMListInsertAfter(L,L->curr, newLink);
+	// already in order: nothing to merge
+	if (! TimestampBefore (items[mid].key, items[mid - 1].key))
+		return steps;
+
+	memcpy (tmp, items, mid * sizeof *tmp);
+	size_t i = 0, j = mid, k = 0;
+	while (i < mid && j < n) {
+		// take from the right half only if strictly earlier
+		if (TimestampBefore (items[j].key, tmp[i].key))
+			items[k++] = items[j++];
+		else
+			items[k++] = tmp[i++];
+		steps++;
 	}
+	while (i < mid)
+		items[k++] = tmp[i++];
+	return steps;
+}
+
+// replace list contents with an already-ordered array of items
+// node heights follow the ideal skip list pattern (1 + number of
+// trailing zeroes in the node's position), so no random levels
+// (this function is used only within the ADT)
+static void rebuildMMList (MMList L, Item *items, size_t n)
+{
+	if (L->arena == NULL)
+		dropMMListNodes (L);
+
+	Link tail[MAX_LEVEL] = { NULL };
+	L->levels = 1;
+	for (int level = 0; level < MAX_LEVEL; level++)
+		L->head[level] = NULL;
+	for (size_t i = 0; i < n; i++) {
+		int height = 1;
+		for (size_t pos = i + 1; (pos & 1) == 0 && height < MAX_LEVEL;
+				pos >>= 1)
+			height++;
+		if (height > L->levels)
+			L->levels = height;
+
+		Link newLink = newMMListNode (L, items[i], height);
+		for (int level = 0; level < height; level++) {
+			if (tail[level] == NULL)
+				L->head[level] = newLink;
+			else
+				tail[level]->next[level] = newLink;
+			tail[level] = newLink;
+		}
+	}
+	L->curr = NULL;
 }
 
 // create a new MMListNode for mail message
 // (this function is used only within the ADT)
-static Link newMMListNode (MailMessage mesg)
+static Link newMMListNode (MMList L, Item item, int height)
 {
-	Link new = malloc (sizeof *new);
-	if (new == NULL) err (EX_OSERR, "couldn't allocate MMList node");
-	*new = (MMListNode) { .data = mesg };
+	Link new = ArenaAlloc (L->arena,
+		sizeof *new + (size_t) height * sizeof (Link));
+	new->data = item.data;
+	new->key = item.key;
+	new->height = height;
+	for (int level = 0; level < height; level++)
+		new->next[level] = NULL;
 	return new;
 }
 
+// choose a height for a new node: height h with probability 1/2^h
+// (xorshift generator, so list shape is the same on every run)
+// (this function is used only within the ADT)
+static int randomLevel (MMList L)
+{
+	unsigned int x = L->seed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	L->seed = x;
+
+	int height = 1;
+	while ((x & 1) && height < MAX_LEVEL) {
+		height++;
+		x >>= 1;
+	}
+	return height;
+}
+
 // check whether a list is ordered (by MailMessageDate)
 bool MMListIsOrdered (MMList L)
 {
-	DateTime prevDate = NULL;
-	for (Link n = L->first; n != NULL; n = n->next) {
-		DateTime currDate = MailMessageDateTime (n->data);
-		if (prevDate != NULL && DateTimeAfter (prevDate, currDate))
+	for (Link n = L->head[0]; n != NULL; n = n->next[0]) {
+		if (n->next[0] != NULL && TimestampAfter (n->key, n->next[0]->key))
 			return false;
-		prevDate = currDate;
 	}
 	return true;
 }
 
+#ifdef MMLIST_VALIDATE
+// check the whole skip list: cached keys match the messages, level 0
+// is ordered, and every higher level visits a subsequence of level 0
+// using only tall enough nodes
+// (debugging aid; this function is used only within the ADT)
+static bool MMListIsValid (MMList L)
+{
+	for (Link n = L->head[0]; n != NULL; n = n->next[0])
+		if (n->key != MailMessageTimestamp (n->data))
+			return false;
+	if (! MMListIsOrdered (L))
+		return false;
+	for (int level = 1; level < L->levels; level++) {
+		Link below = L->head[0];
+		for (Link n = L->head[level]; n != NULL; n = n->next[level]) {
+			if (n->height <= level)
+				return false;
+			while (below != NULL && below != n)
+				below = below->next[0];
+			if (below == NULL)
+				return false;
+		}
+	}
+	for (int level = L->levels; level < MAX_LEVEL; level++)
+		if (L->head[level] != NULL)
+			return false;
+	return true;
+}
+#endif
+
 // start scan of an MMList
 void MMListStart (MMList L)
 {
 	assert (L != NULL);
-	L->curr = L->first;
+	assert (L->npending == 0);
+	L->curr = L->head[0];
 }
 
 // get next item during scan of an MMList
@@ -175,7 +382,7 @@ MailMessage MMListNext (MMList L)
 		return NULL;
 
 	MailMessage mesg = L->curr->data;
-	L->curr = L->curr->next;
+	L->curr = L->curr->next[0];
 	return mesg;
 }
 
@@ -5,6 +5,7 @@
 #define MMLIST_H
 
 #include <stdbool.h>
+#include "Arena.h"
 #include "MailMessage.h"
 
 // External view of MMList
@@ -14,6 +15,10 @@ typedef struct MMListRep *MMList;
 // create a new empty MMList
 MMList newMMList (void);
 
+// create a new empty MMList whose nodes come from an Arena
+// (dropArena releases it; dropMMList need not be called)
+MMList newMMListIn (Arena);
+
 // free up memory associated with list
 void dropMMList (MMList);
 
@@ -24,6 +29,14 @@ void showMMList (MMList);
 // ordering based on MailMessageDate
 void MMListInsert (MMList, MailMessage);
 
+// add mail message to list, without putting it in order yet
+// for bulk loading; call MMListFinalize before using the list
+void MMListAppendUnordered (MMList, MailMessage);
+
+// put all messages added by MMListAppendUnordered in order
+// (one stable sort, with the same tie rule as MMListInsert)
+void MMListFinalize (MMList);
+
 // check whether a list is ordered (by MailMessageDate)
 bool MMListIsOrdered (MMList);
 
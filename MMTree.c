@@ -9,72 +9,116 @@
 #include <string.h>
 #include <sysexits.h>
 
+#include "Arena.h"
 #include "MMTree.h"
 #include "MailMessage.h"
+#include "OutBuf.h"
+#include "Stats.h"
 
 
 // data structures representing MMTree
+// The tree is kept AVL-balanced, so its depth is O(log n) even when
+// IDs arrive in sorted order (as many mail clients generate them).
+// All traversals are iterative: an AVL tree of height h has at least
+// fib(h+2)-1 nodes, so MAX_DEPTH levels of explicit stack are more
+// than enough for any tree that fits in memory.
+#define MAX_DEPTH 100
 typedef struct MMTNode *Link;
 
-//Helper function for Inserting in MMTree
-static Link MMTreeInsertRecursive(Link l,char *id, MailMessage msg);
-
 typedef struct MMTNode {
 	char *msgid;		 // unique ID for message
 	MailMessage message; // details of message
 	Link left, right;	// sub-trees
+	int height;		  // height of sub-tree rooted here (leaf = 1)
 } MMTNode;
 
 typedef struct MMTreeRep {
 	Link root;
+	Arena arena; // where nodes come from (NULL = malloc)
 } MMTreeRep;
 
-static Link newMMTNode (char *id, MailMessage message);
+static Link newMMTNode (Arena arena, char *id, MailMessage message);
 static void doDropMMTree (Link t);
-static void doShowMMTree (Link t, int level);
+static void doShowMMTree (OutBuf out, Link t, int level);
 static MailMessage doMMTreeFind (Link t, char *id);
+static int height (Link t);
+static void fixHeight (Link t);
+static Link rotateLeft (Link t);
+static Link rotateRight (Link t);
+static Link rebalance (Link t);
 
 // create a new empty MMTree
 MMTree newMMTree (void)
 {
-	MMTreeRep *new = malloc (sizeof *new);
-	if (new == NULL) err (EX_OSERR, "couldn't allocate MMTree");
-	*new = (MMTreeRep) { };
+	return newMMTreeIn (NULL);
+}
+
+// create an empty MMTree whose nodes come from an Arena
+// (a NULL Arena means use malloc)
+MMTree newMMTreeIn (Arena arena)
+{
+	MMTreeRep *new = ArenaAlloc (arena, sizeof *new);
+	*new = (MMTreeRep) { .arena = arena };
 	return new;
 }
 
 void dropMMTree (MMTree mmt)
 {
 	assert (mmt != NULL);
+	if (mmt->arena != NULL)
+		return; // nodes are released with the Arena
 	doDropMMTree (mmt->root);
 	free (mmt);
 }
 
 // free memory associated with MMTree
 // note: does not free ID or MailMessage
+// (rotates left sub-trees up until the node to free has none, so no
+// stack is needed at all)
 static void doDropMMTree (Link t)
 {
-	if (t == NULL) return;
-	doDropMMTree (t->left);
-	doDropMMTree (t->right);
-	free (t);
+	while (t != NULL) {
+		if (t->left != NULL) {
+			Link l = t->left;
+			t->left = l->right;
+			l->right = t;
+			t = l;
+		} else {
+			Link r = t->right;
+			free (t);
+			t = r;
+		}
+	}
 }
 
 void showMMTree (MMTree mmt)
 {
 	assert (mmt != NULL);
-	doShowMMTree (mmt->root, 0);
+	OutBuf out = newOutBuf (stdout);
+	doShowMMTree (out, mmt->root, 0);
+	dropOutBuf (out);
 }
 
 // display a MMTree (sideways)
-static void doShowMMTree (Link t, int level)
+// reverse in-order traversal (right, node, left) with explicit stack
+static void doShowMMTree (OutBuf out, Link t, int level)
 {
-	if (t == NULL) return;
-	doShowMMTree (t->right, level + 1);
-	for (int i = 0; i < level; i++)
-		printf ("   ");
-	printf ("%s\n", t->msgid);
-	doShowMMTree (t->left, level + 1);
+	struct { Link node; int level; } stack[MAX_DEPTH];
+	int n = 0;
+	while (t != NULL || n > 0) {
+		for (; t != NULL; t = t->right, level++) {
+			assert (n < MAX_DEPTH);
+			stack[n].node = t;
+			stack[n++].level = level;
+		}
+		t = stack[--n].node;
+		level = stack[n].level;
+		OutBufIndent (out, 3 * level);
+		OutBufPuts (out, t->msgid);
+		OutBufWrite (out, "\n", 1);
+		t = t->left;
+		level++;
+	}
 }
 
 MailMessage MMTreeFind (MMTree mmt, char *id)
@@ -84,63 +128,121 @@ MailMessage MMTreeFind (MMTree mmt, char *id)
 }
 
 // check whether a message with ID is in a MMTree
+// (one strcmp per level)
 static MailMessage doMMTreeFind (Link t, char *id)
 {
-	if (t == NULL)
-		return NULL;
-	else if (strcmp (id, t->msgid) <  0)
-		return doMMTreeFind (t->left, id);
-	else if (strcmp (id, t->msgid)  > 0)
-		return doMMTreeFind (t->right, id);
-	else // (strcmp (id, t->msgid) == 0)
-		return t->message;
-}
-
-//Helper function for MMTreeInsert
-static Link MMTreeInsertRecursive(Link l, char* id, MailMessage mesg){
-	if(l == NULL){
-		//create new node
-		Link newNode = newMMTNode(id,mesg); 
-		return newNode;
+	unsigned long long compares = 0;
+	while (t != NULL) {
+		int cmp = strcmp (id, t->msgid);
+		compares++;
+		if (cmp == 0)
+			break;
+		t = (cmp < 0) ? t->left : t->right;
 	}
-	if(strcmp(l->msgid, id) < 0){
-		l->right = MMTreeInsertRecursive(l->right,id,mesg);
-	}else{
-		l->left = MMTreeInsertRecursive(l->left,id, mesg);
-	}
-	return l;
+	StatsCount (ST_TREE_FINDS, 1);
+	StatsCount (ST_TREE_COMPARES, compares);
+	return (t == NULL) ? NULL : t->message;
 }
 
 // insert a new message into a MMTree
 // message is indexed by a string ID
+// IDs equal to a node's ID go into its left sub-tree; the path down
+// is remembered so the tree can be rebalanced on the way back up
 MMTree MMTreeInsert (MMTree t, char *id, MailMessage mesg)
 {
-	if(t->root == NULL){
-		//tree is empty
-		//Create node
-		Link newNode = newMMTNode(id,mesg);
-		t->root = newNode;
-		return t;
+	assert (t != NULL);
+	Link *path[MAX_DEPTH];
+	int depth = 0;
+
+	Link *link = &t->root;
+	while (*link != NULL) {
+		assert (depth < MAX_DEPTH);
+		path[depth++] = link;
+		link = (strcmp ((*link)->msgid, id) < 0) ?
+			&(*link)->right : &(*link)->left;
 	}
-	
-	if( strcmp(t->root->msgid, id) < 0 ){
-		//id is bigger than curr link
-		t->root->right = MMTreeInsertRecursive(t->root->right,id, mesg);
-	}else{
-		t->root->left = MMTreeInsertRecursive(t->root->left,id, mesg);
+	*link = newMMTNode (t->arena, id, mesg);
+	StatsCount (ST_TREE_INSERTS, 1);
+	StatsCount (ST_TREE_COMPARES, (unsigned long long) depth);
+
+	// once a sub-tree's height is unchanged, nothing above it changes
+	while (depth > 0) {
+		link = path[--depth];
+		int oldHeight = (*link)->height;
+		*link = rebalance (*link);
+		if ((*link)->height == oldHeight)
+			break;
 	}
+	return t;
+}
+
+// depth of MMTree (number of nodes on longest root-to-leaf path)
+int MMTreeDepth (MMTree t)
+{
+	assert (t != NULL);
+	return height (t->root);
+}
+
+// AVL helpers
+// (these functions are used only within the ADT)
+
+static int height (Link t)
+{
+	return (t == NULL) ? 0 : t->height;
+}
+
+static void fixHeight (Link t)
+{
+	int hl = height (t->left), hr = height (t->right);
+	t->height = 1 + ((hl > hr) ? hl : hr);
+}
+
+static Link rotateLeft (Link t)
+{
+	Link r = t->right;
+	t->right = r->left;
+	r->left = t;
+	fixHeight (t);
+	fixHeight (r);
+	return r;
+}
 
+static Link rotateRight (Link t)
+{
+	Link l = t->left;
+	t->left = l->right;
+	l->right = t;
+	fixHeight (t);
+	fixHeight (l);
+	return l;
+}
+
+// restore AVL balance at t after one of its sub-trees changed height
+static Link rebalance (Link t)
+{
+	fixHeight (t);
+	int balance = height (t->left) - height (t->right);
+	if (balance > 1) {
+		if (height (t->left->left) < height (t->left->right))
+			t->left = rotateLeft (t->left);
+		return rotateRight (t);
+	}
+	if (balance < -1) {
+		if (height (t->right->right) < height (t->right->left))
+			t->right = rotateRight (t->right);
+		return rotateLeft (t);
+	}
 	return t;
 }
 
 // make a new node containing a value
 // (this function is used only within the ADT)
-static Link newMMTNode (char *id, MailMessage message)
+static Link newMMTNode (Arena arena, char *id, MailMessage message)
 {
-	Link new = malloc (sizeof (MMTNode));
-	assert (new != NULL);
+	Link new = ArenaAlloc (arena, sizeof (MMTNode));
 	new->msgid = id;
 	new->message = message;
 	new->left = new->right = NULL;
+	new->height = 1;
 	return new;
 }
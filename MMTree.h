@@ -4,6 +4,7 @@
 #ifndef MMTREE_H
 #define MMTREE_H
 
+#include "Arena.h"
 #include "MailMessage.h"
 
 // external view of MMTree
@@ -13,6 +14,10 @@ typedef struct MMTreeRep *MMTree;
 // create an empty MMTree
 MMTree newMMTree (void);
 
+// create an empty MMTree whose nodes come from an Arena
+// (dropArena releases it; dropMMTree need not be called)
+MMTree newMMTreeIn (Arena);
+
 // free memory associated with MMTree
 void dropMMTree (MMTree);
 
@@ -26,4 +31,13 @@ MMTree MMTreeInsert (MMTree, char *, MailMessage);
 // check whether a message with ID is in a MMTree
 MailMessage MMTreeFind (MMTree, char *);
 
+// depth of MMTree; what it measures depends on the implementation
+// (see MMTREE in the Makefile):
+// - MMTree: number of nodes on the longest root-to-leaf path; the
+//   tree is balanced, so this is O(log n)
+// - MMTreeHash: the longest probe sequence (number of slots looked
+//   at) needed by any insertion; usually small, whatever n is
+// (this is the "depth" that --stats reports)
+int MMTreeDepth (MMTree);
+
 #endif
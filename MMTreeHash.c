@@ -0,0 +1,190 @@
+// MMTreeHash.c ... hash table implementation of Mail Message search tree ADT
+// An alternative to MMTree.c, selected at build time (make MMTREE=MMTreeHash)
+// Each slot contains an (ID,message) pair; only exact-match search by ID
+// is supported, which is all that MMTreeFind needs.  IDs are hashed once
+// on insert and on lookup, and live in a flat open-addressing array
+// (linear probing), so a lookup usually touches one or two cache lines.
+
+#include <assert.h>
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+
+#include "Arena.h"
+#include "Hash.h"
+#include "MMTree.h"
+#include "MailMessage.h"
+#include "OutBuf.h"
+#include "Stats.h"
+
+// data structures representing MMTree
+
+typedef struct MMTSlot {
+	char *msgid;		 // unique ID for message (NULL = empty slot)
+	MailMessage message; // details of message
+	uint64_t hash;		 // hash of msgid
+} MMTSlot;
+
+typedef struct MMTreeRep {
+	MMTSlot *slots; // hash table
+	size_t nslots;  // size of table (power of 2)
+	size_t nitems;  // number of slots in use
+	int maxProbe;   // longest probe sequence needed so far
+	Arena arena;    // where tables come from (NULL = malloc)
+} MMTreeRep;
+
+#define MIN_SLOTS 64
+
+static MMTSlot *newSlots (Arena arena, size_t nslots);
+static void growMMTree (MMTree t);
+static int insertSlot (MMTree t, char *id, MailMessage mesg, uint64_t hash);
+
+// create a new empty MMTree
+MMTree newMMTree (void)
+{
+	return newMMTreeIn (NULL);
+}
+
+// create an empty MMTree whose tables come from an Arena
+// (a NULL Arena means use malloc)
+MMTree newMMTreeIn (Arena arena)
+{
+	MMTreeRep *new = ArenaAlloc (arena, sizeof *new);
+	*new = (MMTreeRep) { .nslots = MIN_SLOTS, .arena = arena };
+	new->slots = newSlots (arena, new->nslots);
+	return new;
+}
+
+// free memory associated with MMTree
+// note: does not free ID or MailMessage
+void dropMMTree (MMTree t)
+{
+	assert (t != NULL);
+	if (t->arena != NULL)
+		return; // tables are released with the Arena
+	free (t->slots);
+	free (t);
+}
+
+// display a MMTree (one ID per line, in table order)
+void showMMTree (MMTree t)
+{
+	assert (t != NULL);
+	OutBuf out = newOutBuf (stdout);
+	for (size_t i = 0; i < t->nslots; i++) {
+		if (t->slots[i].msgid != NULL) {
+			OutBufPuts (out, t->slots[i].msgid);
+			OutBufWrite (out, "\n", 1);
+		}
+	}
+	dropOutBuf (out);
+}
+
+// insert a new message into a MMTree
+// message is indexed by a string ID
+MMTree MMTreeInsert (MMTree t, char *id, MailMessage mesg)
+{
+	assert (t != NULL);
+	assert (id != NULL);
+
+	// grow first, so that the probes counted are those in the table
+	// the item ends up in
+	if (2 * (t->nitems + 1) > t->nslots)
+		growMMTree (t);
+	int probes = insertSlot (t, id, mesg, hashBytes (id, strlen (id)));
+	t->nitems++;
+	StatsCount (ST_TREE_INSERTS, 1);
+	StatsCount (ST_TREE_COMPARES, (unsigned long long) probes);
+	return t;
+}
+
+// check whether a message with ID is in a MMTree
+// (with duplicate IDs, finds the one inserted first)
+MailMessage MMTreeFind (MMTree t, char *id)
+{
+	assert (t != NULL);
+	if (id == NULL)
+		return NULL;
+
+	uint64_t hash = hashBytes (id, strlen (id));
+	size_t mask = t->nslots - 1;
+	unsigned long long probes = 0;
+	MailMessage found = NULL;
+	for (size_t i = (size_t) hash & mask; t->slots[i].msgid != NULL;
+			i = (i + 1) & mask) {
+		MMTSlot *s = &t->slots[i];
+		probes++;
+		if (s->hash == hash && strcmp (s->msgid, id) == 0) {
+			found = s->message;
+			break;
+		}
+	}
+	StatsCount (ST_TREE_FINDS, 1);
+	StatsCount (ST_TREE_COMPARES, probes);
+	return found;
+}
+
+// depth of MMTree: for the hash table, the longest probe sequence
+// (number of slots examined) needed by any insertion so far
+int MMTreeDepth (MMTree t)
+{
+	assert (t != NULL);
+	return t->maxProbe;
+}
+
+// put (ID,message) pair into first free slot on its probe sequence
+// returns the number of slots probed
+// (this function is used only within the ADT)
+static int insertSlot (MMTree t, char *id, MailMessage mesg, uint64_t hash)
+{
+	size_t mask = t->nslots - 1;
+	size_t i = (size_t) hash & mask;
+	int probe = 1;
+	while (t->slots[i].msgid != NULL) {
+		i = (i + 1) & mask;
+		probe++;
+	}
+	t->slots[i] = (MMTSlot) { .msgid = id, .message = mesg, .hash = hash };
+	if (probe > t->maxProbe)
+		t->maxProbe = probe;
+	return probe;
+}
+
+// double size of hash table, re-inserting all items
+// (this function is used only within the ADT)
+static void growMMTree (MMTree t)
+{
+	MMTSlot *old = t->slots;
+	size_t nold = t->nslots;
+
+	t->nslots *= 2;
+	t->slots = newSlots (t->arena, t->nslots);
+	t->maxProbe = 0;
+
+	// re-inserting in old table order keeps duplicates in insertion
+	// order along each probe sequence, as long as we start from the
+	// beginning of a cluster (a slot whose predecessor is empty)
+	size_t first = 0;
+	while (first < nold && old[(first + nold - 1) % nold].msgid != NULL)
+		first++;
+	for (size_t k = 0; k < nold; k++) {
+		MMTSlot *s = &old[(first + k) % nold];
+		if (s->msgid != NULL)
+			insertSlot (t, s->msgid, s->message, s->hash);
+	}
+	if (t->arena == NULL)
+		free (old);
+}
+
+// make an empty hash table
+// (this function is used only within the ADT)
+static MMTSlot *newSlots (Arena arena, size_t nslots)
+{
+	MMTSlot *slots = ArenaAlloc (arena, nslots * sizeof *slots);
+	for (size_t i = 0; i < nslots; i++)
+		slots[i] = (MMTSlot) { };
+	return slots;
+}
@@ -0,0 +1,528 @@
+// MailBox.c ... implementation of memory-mapped Mailbox reader ADT
+// The file is mapped private and writable: pages are only copied
+// if scanMailMessage writes into them (to terminate header values),
+// so message bodies are never copied, and headers are never strdup'd.
+//
+// A MailBox can also keep a sidecar index file (see MailBoxUseIndex)
+// recording where each message starts, and its date.  Messages
+// covered by a valid index are read by scanning their headers only:
+// bodies are skipped without being touched, Date: fields are not
+// parsed, and the parse is split exactly by message.
+
+#include <assert.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sysexits.h>
+#include <unistd.h>
+
+#include "Arena.h"
+#include "Hash.h"
+#include "IDTable.h"
+#include "MailBox.h"
+#include "MailMessage.h"
+#include "Scan.h"
+#include "Stats.h"
+
+// data structures representing MailBox
+
+// index file layout: an IndexHeader, then one IndexEntry per message
+// (in host byte order; a file from another host fails validation)
+
+#define INDEX_MAGIC "MBOXIDX2"
+#define INDEX_ORDER 0x01020304
+
+typedef struct IndexHeader {
+	char magic[8];		// INDEX_MAGIC
+	uint32_t order;		// INDEX_ORDER (checks byte order)
+	uint32_t entrySize;	// sizeof (IndexEntry) (checks layout)
+	uint64_t dev, ino;	// identity of mailbox file
+	uint64_t size;		// bytes of mailbox covered by index
+	int64_t mtime, mtimeNsec; // modification time of mailbox
+	uint64_t sample;	// checksum of last SAMPLE bytes covered
+	uint64_t nentries;	// number of IndexEntry's that follow
+	uint64_t checksum;	// checksum of the IndexEntry's
+} IndexHeader;
+
+typedef struct IndexEntry {
+	uint64_t offset;	// start of message ("From " line)
+	int64_t timestamp;	// "Date:" field, as a Timestamp
+	int32_t zone;		// ... and its zone offset
+	uint32_t spare;		// 0 (so the checksum covers no padding)
+} IndexEntry;
+
+// how much of the mailbox the sample checksum covers
+#define SAMPLE 4096
+
+// data structures representing MailBox
+
+typedef struct MailBoxRep {
+	char *image;  // start of mailbox image in memory
+	size_t size;  // size of image (bytes)
+	bool mapped;  // image is a file mapping (else a heap copy)
+	char *curr;   // current position (for MailBoxNext)
+	Arena arena;  // memory for messages read from mailbox
+	IDTable ids;  // IDs of messages read from mailbox
+	char *path;   // name of mailbox file
+	struct stat info; // mailbox file details, when opened
+	char *indexPath;  // sidecar index file (NULL = none)
+	IndexEntry *index; // valid entries from index file
+	size_t nindexed;  // number of entries in index
+	size_t indexedSize; // bytes of mailbox covered by index
+	uint64_t sample;  // sample checksum for the whole mailbox
+} MailBoxRep;
+
+// a part of the image, parsed by one worker thread
+// messages listed in the index come first, then any found by
+// scanning the byte range start..end
+typedef struct Chunk {
+	IndexEntry *entries;	// indexed messages to read
+	size_t nentries;	// number of indexed messages
+	char *base, *top;	// image, and its end (for indexed messages)
+	char *start, *end;	// range to scan
+	MailMessage *mesgs;	// messages found, in mailbox order
+	size_t nmesgs, max;	// number of messages, size of array
+	Arena arena;		// memory for messages found
+} Chunk;
+
+// don't bother splitting off chunks smaller than this
+// (indexed messages are cheap to read, so they're split by count)
+#define MIN_CHUNK (1 << 20)
+#define MIN_INDEXED 4096
+
+static char *readImage (int fd, size_t size);
+static char *nextSeparator (char *p, char *start, char *end);
+static void *parseChunk (void *arg);
+static void addMessage (Chunk *c, MailMessage mesg);
+static bool loadIndex (MailBox mb);
+static bool validIndex (MailBox mb, IndexHeader *h, IndexEntry *entries);
+static void saveIndex (MailBox mb, MailMessage *mesgs, size_t nmesgs);
+static bool isSeparator (MailBox mb, size_t offset);
+static uint64_t sampleSum (MailBox mb, size_t size);
+
+// open and map a mailbox file
+// return NULL (with errno set) if file can't be opened or mapped
+MailBox newMailBox (char *path)
+{
+	int fd = open (path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	struct stat info;
+	if (fstat (fd, &info) < 0) {
+		close (fd);
+		return NULL;
+	}
+
+	MailBoxRep *new = malloc (sizeof *new);
+	if (new == NULL) err (EX_OSERR, "couldn't allocate MailBox");
+	*new = (MailBoxRep) { .size = (size_t) info.st_size, .info = info };
+	if ((new->path = strdup (path)) == NULL)
+		err (EX_OSERR, "couldn't allocate MailBox");
+
+	if (new->size > 0) {
+		new->image = mmap (NULL, new->size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE, fd, 0);
+		if (new->image == MAP_FAILED) {
+			close (fd);
+			free (new->path);
+			free (new);
+			return NULL;
+		}
+		new->mapped = true;
+		madvise (new->image, new->size, MADV_SEQUENTIAL);
+
+		// scanMailMessage needs the image to end with '\n';
+		// if the file doesn't, fall back to an extended heap copy
+		if (new->image[new->size - 1] != '\n') {
+			munmap (new->image, new->size);
+			new->image = readImage (fd, new->size);
+			new->image[new->size++] = '\n';
+			new->mapped = false;
+		}
+	}
+	close (fd);
+
+	new->curr = new->image;
+	new->arena = newArena ();
+	new->ids = newIDTable ();
+	return new;
+}
+
+// unmap mailbox and free memory associated with it
+void dropMailBox (MailBox mb)
+{
+	assert (mb != NULL);
+	if (mb->mapped)
+		munmap (mb->image, mb->size);
+	else
+		free (mb->image);
+	dropArena (mb->arena);
+	dropIDTable (mb->ids);
+	free (mb->path);
+	free (mb->indexPath);
+	free (mb->index);
+	free (mb);
+}
+
+// Arena that holds this mailbox's messages
+Arena MailBoxArena (MailBox mb)
+{
+	assert (mb != NULL);
+	return mb->arena;
+}
+
+// IDTable holding IDs of messages read from mailbox
+IDTable MailBoxIDs (MailBox mb)
+{
+	assert (mb != NULL);
+	return mb->ids;
+}
+
+// read next Mail Message from mailbox
+// return NULL if at end of mailbox instead of message
+MailMessage MailBoxNext (MailBox mb)
+{
+	assert (mb != NULL);
+	if (mb->image == NULL)
+		return NULL; // empty mailbox
+	MailMessage mesg =
+		scanMailMessage (&mb->curr, mb->image + mb->size, mb->arena);
+	if (mesg != NULL) {
+		MailMessageIntern (mesg, mb->ids);
+		StatsCount (ST_PARSED, 1);
+	}
+	return mesg;
+}
+
+// keep a sidecar index for the mailbox in the named file
+// (NULL means the mailbox's name with ".idx" appended)
+// if the index matches the mailbox, or an earlier version of it that
+// has since been appended to, MailBoxReadAll reads the messages it
+// covers without scanning their bodies, and only scans the rest;
+// whenever MailBoxReadAll finds messages that the index doesn't
+// cover, it rewrites the index
+void MailBoxUseIndex (MailBox mb, char *path)
+{
+	assert (mb != NULL);
+	free (mb->indexPath);
+	if (path != NULL)
+		mb->indexPath = strdup (path);
+	else if (asprintf (&mb->indexPath, "%s.idx", mb->path) < 0)
+		mb->indexPath = NULL;
+	if (mb->indexPath == NULL)
+		err (EX_OSERR, "couldn't allocate MailBox index name");
+
+	// header values get terminated in place as messages are read, so
+	// the sample for the new index must be taken before that
+	mb->sample = sampleSum (mb, (size_t) mb->info.st_size);
+	if (! loadIndex (mb)) {
+		free (mb->index);
+		mb->index = NULL;
+		mb->nindexed = mb->indexedSize = 0;
+	}
+}
+
+// read all remaining messages, parsing on (up to) nthreads threads
+// the unread part of the image is split into one byte range per
+// thread, and each split point is moved forward to the start of the
+// next "From " line, so every message lies wholly within one chunk
+// if an index is in use (and nothing has been read yet), the indexed
+// messages are split evenly between threads instead, and whatever
+// follows them is scanned by the thread that reads the last ones
+MailMessage *MailBoxReadAll (MailBox mb, int nthreads, size_t *nmesgs)
+{
+	assert (mb != NULL);
+	assert (nmesgs != NULL);
+	if (mb->image == NULL) {
+		// empty mailbox: no messages, and nothing to index
+		MailMessage *none = malloc (sizeof *none);
+		if (none == NULL)
+			err (EX_OSERR, "couldn't allocate MailBox messages");
+		*nmesgs = 0;
+		return none;
+	}
+
+	bool fromStart = (mb->curr == mb->image);
+	size_t nindexed = fromStart ? mb->nindexed : 0;
+	char *start = mb->curr + ((nindexed > 0) ? mb->indexedSize : 0);
+	char *end = mb->image + mb->size;
+	size_t size = (size_t) (end - start);
+	if (nthreads < 1)
+		nthreads = (int) sysconf (_SC_NPROCESSORS_ONLN);
+	if (nindexed > 0) {
+		if (nthreads < 1 || nindexed / MIN_INDEXED < (size_t) nthreads)
+			nthreads = (int) (nindexed / MIN_INDEXED) + 1;
+	} else if (nthreads < 1 || size / MIN_CHUNK < (size_t) nthreads)
+		nthreads = (int) (size / MIN_CHUNK) + 1;
+
+	Chunk *chunks = calloc ((size_t) nthreads, sizeof *chunks);
+	pthread_t *workers = calloc ((size_t) nthreads, sizeof *workers);
+	if (chunks == NULL || workers == NULL)
+		err (EX_OSERR, "couldn't allocate MailBox chunks");
+
+	// choose chunk boundaries
+	char *split = start;
+	for (int i = 0; i < nthreads; i++) {
+		if (nindexed > 0) {
+			size_t first = nindexed * (size_t) i / (size_t) nthreads;
+			size_t next = nindexed * (size_t) (i + 1) / (size_t) nthreads;
+			chunks[i].entries = &mb->index[first];
+			chunks[i].nentries = next - first;
+			chunks[i].base = mb->image;
+			chunks[i].top = end;
+			chunks[i].start = start;
+			chunks[i].end = (i < nthreads - 1) ? start : end;
+			continue;
+		}
+		chunks[i].start = split;
+		if (i < nthreads - 1)
+			split = nextSeparator (start + size / (size_t) nthreads
+				* (size_t) (i + 1), split, end);
+		else
+			split = end;
+		chunks[i].end = split;
+	}
+
+	// parse chunks; the first one is done by the calling thread
+	// (Arenas aren't thread-safe, so each worker gets its own)
+	chunks[0].arena = mb->arena;
+	for (int i = 1; i < nthreads; i++)
+		chunks[i].arena = newArena ();
+	for (int i = 1; i < nthreads; i++)
+		if ((errno = pthread_create (&workers[i], NULL,
+				parseChunk, &chunks[i])) != 0)
+			err (EX_OSERR, "couldn't start MailBox worker");
+	parseChunk (&chunks[0]);
+	for (int i = 1; i < nthreads; i++) {
+		pthread_join (workers[i], NULL);
+		ArenaAdopt (mb->arena, chunks[i].arena);
+	}
+	mb->curr = end;
+
+	// concatenate per-chunk results (chunks are in mailbox order)
+	size_t total = 0;
+	for (int i = 0; i < nthreads; i++)
+		total += chunks[i].nmesgs;
+	MailMessage *all = malloc ((total + 1) * sizeof *all);
+	if (all == NULL) err (EX_OSERR, "couldn't allocate MailBox messages");
+	size_t n = 0;
+	for (int i = 0; i < nthreads; i++) {
+		if (chunks[i].nmesgs > 0)
+			memcpy (&all[n], chunks[i].mesgs,
+				chunks[i].nmesgs * sizeof *all);
+		n += chunks[i].nmesgs;
+		free (chunks[i].mesgs);
+	}
+	free (chunks);
+	free (workers);
+
+	// IDs are interned here, not by the workers, so that handles are
+	// given out in mailbox order whatever the number of threads
+	for (size_t i = 0; i < total; i++)
+		MailMessageIntern (all[i], mb->ids);
+
+	if (mb->indexPath != NULL && fromStart && total > nindexed)
+		saveIndex (mb, all, total);
+
+	*nmesgs = total;
+	return all;
+}
+
+// find start of first "From " line at or after p
+// (but never before start, the previous split point)
+// (this function is used only within the ADT)
+static char *nextSeparator (char *p, char *start, char *end)
+{
+	if (p <= start)
+		return start;
+	// a line starts at p only if the byte before it is '\n'
+	char *sep = ScanSeparator (p - 1, end);
+	return (sep == NULL) ? end : sep + 1;
+}
+
+// worker: read all messages in a chunk
+// an indexed message starts exactly at its "From " line, so
+// scanMailMessage reads its headers and never looks at its body
+// (this function is used only within the ADT)
+static void *parseChunk (void *arg)
+{
+	Chunk *c = arg;
+	MailMessage mesg;
+	for (size_t i = 0; i < c->nentries; i++) {
+		IndexEntry *e = &c->entries[i];
+		char *pos = c->base + e->offset;
+		DateTimeRep date = { .timestamp = e->timestamp, .zone = e->zone };
+		mesg = scanMailMessageDated (&pos, c->top, c->arena, &date);
+		assert (mesg != NULL);
+		addMessage (c, mesg);
+	}
+	while ((mesg = scanMailMessage (&c->start, c->end, c->arena)) != NULL)
+		addMessage (c, mesg);
+	StatsCount (ST_PARSED, c->nmesgs);
+	StatsCount (ST_SKIPPED, c->nentries);
+	return NULL;
+}
+
+// append a message to a chunk's results
+// (this function is used only within the ADT)
+static void addMessage (Chunk *c, MailMessage mesg)
+{
+	if (c->nmesgs == c->max) {
+		c->max = (c->max == 0) ? 64 : 2 * c->max;
+		c->mesgs = realloc (c->mesgs, c->max * sizeof *c->mesgs);
+		if (c->mesgs == NULL)
+			err (EX_OSERR, "couldn't allocate MailBox messages");
+	}
+	c->mesgs[c->nmesgs++] = mesg;
+}
+
+// read the index file, and keep its entries if it is valid for
+// the mailbox; return false if there is no usable index
+// (this function is used only within the ADT)
+static bool loadIndex (MailBox mb)
+{
+	FILE *in = fopen (mb->indexPath, "r");
+	if (in == NULL)
+		return false;
+
+	IndexHeader h;
+	bool ok = fread (&h, sizeof h, 1, in) == 1 &&
+		memcmp (h.magic, INDEX_MAGIC, sizeof h.magic) == 0 &&
+		h.order == INDEX_ORDER && h.entrySize == sizeof (IndexEntry) &&
+		h.nentries > 0 && h.nentries < SIZE_MAX / sizeof (IndexEntry);
+	if (ok) {
+		mb->index = malloc (h.nentries * sizeof (IndexEntry));
+		if (mb->index == NULL)
+			err (EX_OSERR, "couldn't allocate MailBox index");
+		ok = fread (mb->index, sizeof (IndexEntry), h.nentries, in)
+			== h.nentries && validIndex (mb, &h, mb->index);
+	}
+	fclose (in);
+	if (ok) {
+		mb->nindexed = h.nentries;
+		mb->indexedSize = h.size;
+	}
+	return ok;
+}
+
+// check that an index describes this mailbox (or a prefix of it)
+// - it must be for the same file, and if the file's size is as
+//   indexed, it must also have the same modification time
+// - the last SAMPLE bytes covered must be unchanged, and if the file
+//   has grown, what was appended must start with a new message
+// - the entries must be intact, and every message must start where
+//   the index says it does
+// (this function is used only within the ADT)
+static bool validIndex (MailBox mb, IndexHeader *h, IndexEntry *entries)
+{
+	struct stat *info = &mb->info;
+	if (h->dev != (uint64_t) info->st_dev ||
+		h->ino != (uint64_t) info->st_ino ||
+		h->size > (uint64_t) info->st_size)
+		return false;
+	if (h->size == (uint64_t) info->st_size &&
+		(h->mtime != info->st_mtim.tv_sec ||
+		h->mtimeNsec != info->st_mtim.tv_nsec))
+		return false;
+	if (h->size < (uint64_t) info->st_size &&
+		! isSeparator (mb, (size_t) h->size))
+		return false;
+	if (h->sample != sampleSum (mb, (size_t) h->size) ||
+		h->checksum != hashBytes (entries,
+			h->nentries * sizeof *entries))
+		return false;
+
+	for (size_t i = 0; i < h->nentries; i++)
+		if (entries[i].offset >= h->size ||
+			(i > 0 && entries[i].offset <= entries[i - 1].offset) ||
+			! isSeparator (mb, (size_t) entries[i].offset))
+			return false;
+	return true;
+}
+
+// write an index covering all messages in the mailbox
+// (a new index file is written and renamed over the old one, so
+// readers never see a partial index; failing to write it isn't
+// fatal, as the index is only a cache of what's in the mailbox)
+// (this function is used only within the ADT)
+static void saveIndex (MailBox mb, MailMessage *mesgs, size_t nmesgs)
+{
+	IndexEntry *entries = malloc (nmesgs * sizeof *entries);
+	if (entries == NULL)
+		err (EX_OSERR, "couldn't allocate MailBox index");
+	for (size_t i = 0; i < nmesgs; i++) {
+		DateTime date = MailMessageDateTime (mesgs[i]);
+		entries[i] = (IndexEntry) {
+			.offset = (uint64_t) (MailMessageText (mesgs[i]) - mb->image),
+			.timestamp = date->timestamp, .zone = date->zone
+		};
+	}
+
+	IndexHeader h = {
+		.magic = INDEX_MAGIC, .order = INDEX_ORDER,
+		.entrySize = sizeof (IndexEntry),
+		.dev = (uint64_t) mb->info.st_dev, .ino = (uint64_t) mb->info.st_ino,
+		.size = (uint64_t) mb->info.st_size,
+		.mtime = mb->info.st_mtim.tv_sec,
+		.mtimeNsec = mb->info.st_mtim.tv_nsec,
+		.sample = mb->sample, .nentries = nmesgs,
+		.checksum = hashBytes (entries, nmesgs * sizeof *entries)
+	};
+
+	char *tmp;
+	if (asprintf (&tmp, "%s.tmp", mb->indexPath) < 0)
+		err (EX_OSERR, "couldn't allocate MailBox index name");
+	FILE *out = fopen (tmp, "w");
+	bool ok = out != NULL &&
+		fwrite (&h, sizeof h, 1, out) == 1 &&
+		fwrite (entries, sizeof *entries, nmesgs, out) == nmesgs;
+	if (out != NULL && fclose (out) != 0)
+		ok = false;
+	if (! ok || rename (tmp, mb->indexPath) != 0) {
+		warn ("couldn't write index %s", mb->indexPath);
+		unlink (tmp);
+	}
+	free (tmp);
+	free (entries);
+}
+
+// does a "From " line start at offset in the mailbox image?
+// (this function is used only within the ADT)
+static bool isSeparator (MailBox mb, size_t offset)
+{
+	return offset + 5 <= mb->size &&
+		(offset == 0 || mb->image[offset - 1] == '\n') &&
+		strncmp (&mb->image[offset], "From ", 5) == 0;
+}
+
+// checksum of the (up to) SAMPLE bytes before size in the image
+// (this function is used only within the ADT)
+static uint64_t sampleSum (MailBox mb, size_t size)
+{
+	size_t from = (size > SAMPLE) ? size - SAMPLE : 0;
+	return hashBytes (mb->image + from, size - from);
+}
+
+// read whole file into a heap buffer with one spare byte
+// (this function is used only within the ADT)
+static char *readImage (int fd, size_t size)
+{
+	char *buf = malloc (size + 1);
+	if (buf == NULL) err (EX_OSERR, "couldn't allocate MailBox image");
+	size_t nread = 0;
+	while (nread < size) {
+		ssize_t n = pread (fd, buf + nread, size - nread, (off_t) nread);
+		if (n <= 0) err (EX_IOERR, "couldn't read mailbox");
+		nread += (size_t) n;
+	}
+	return buf;
+}
@@ -0,0 +1,54 @@
+// MailBox.h ... interface to memory-mapped Mailbox reader ADT
+// A MailBox maps a whole mbox file into memory once; messages are
+// then read by walking a pointer through the mapped image.
+
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include "Arena.h"
+#include "IDTable.h"
+#include "MailMessage.h"
+
+// External view of MailBox
+
+typedef struct MailBoxRep *MailBox;
+
+// open and map a mailbox file
+// return NULL (with errno set) if file can't be opened or mapped
+MailBox newMailBox (char *);
+
+// unmap mailbox and free memory associated with it
+// note: every MailMessage read from the mailbox lives in the
+// mailbox's Arena and refers to the mapped image, so this also
+// releases all such messages (and anything else in MailBoxArena)
+void dropMailBox (MailBox);
+
+// Arena that holds this mailbox's messages; other structures built
+// from the messages can be allocated here too, for one bulk release
+Arena MailBoxArena (MailBox);
+
+// IDTable in which every message read from this mailbox has had
+// its Message-ID and In-Reply-To ID interned (in mailbox order)
+IDTable MailBoxIDs (MailBox);
+
+// read next Mail Message from mailbox
+// return NULL if at end of mailbox instead of message
+// (reentrant: a MailBox holds all of its reader state, so each
+// thread can read from its own MailBox without any locking)
+MailMessage MailBoxNext (MailBox);
+
+// keep a sidecar index of where each message starts in the named
+// file (NULL means the mailbox's name with ".idx" appended)
+// MailBoxReadAll then only scans the parts of the mailbox that the
+// index doesn't cover (e.g. mail appended since the index was
+// written), and updates the index if it finds any new messages
+// (an index that doesn't match the mailbox is ignored, and replaced)
+void MailBoxUseIndex (MailBox, char *);
+
+// read all remaining messages, parsing on (up to) nthreads threads
+// nthreads < 1 means use one thread per online CPU
+// returns a malloc'd array of the messages, in mailbox order,
+// and sets *nmesgs to the number of messages in the array
+MailMessage *MailBoxReadAll (MailBox, int nthreads, size_t *nmesgs);
+
+#endif
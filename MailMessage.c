@@ -2,28 +2,72 @@
 // Written by John Shepherd, Feb 2019
 
 #include <assert.h>
+#include <ctype.h>
 #include <err.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sysexits.h>
 
 #include "DateTime.h"
+#include "IDTable.h"
 #include "MailMessage.h"
-
-// according to RFC5322
-#define MAXLINE 1000
+#include "OutBuf.h"
+#include "Scan.h"
+#include "Stats.h"
 
 // data structures to represent Mail Messages
+// Header fields are kept as offsets into the message's text, which
+// is either the mailbox image (starting at the message's "From "
+// line) or, for getMailMessage, a heap copy of its header lines.
+// An offset of 0 means the field is missing.
+// - a field folded over several lines is unfolded in place, and
+//   then '\0'-terminated
+// - the IDs in references are packed together in place when the
+//   message is read, each ending in '\0' (see packIDs)
+// - id and replyTo are needed for threading, so they are '\0'-
+//   terminated when the message is read
+// - subject and from run to the end of their header line, and are
+//   only terminated if their accessor is called; display works out
+//   their length instead, so it never writes to the image
+// - the body is found in the image when it is asked for
 
 typedef struct MailMessageRep {
-	char *id;	  // "Message-ID:" field (id format)
-	char *subject; // "Subject:" field (free text)
-	char *from;	// "From:" field (email address)
-	DateTime date; // "Date:" field (parsed)
-	char *replyTo; // "Reply-To:" field (as for id)
+	char *text;	  // mailbox image or heap copy (see above)
+	DateTimeRep date; // "Date:" field (parsed, stored inline)
+	uint32_t id;	  // "Message-ID:" field (id format)
+	uint32_t replyTo; // "In-Reply-To:" field (as for id)
+	uint32_t subject; // "Subject:" field (free text)
+	uint32_t from;	  // "From:" field (email address)
+	uint32_t body;	  // start of body (0 = not kept)
+	uint32_t limit;	  // body ends at next "From " line, or here
+	uint32_t references; // "References:" field (packed IDs)
+	MsgID idKey;	  // interned id (NO_MSGID until interned)
+	MsgID replyKey;	  // interned replyTo (as for idKey)
+	uint16_t nrefs;	  // number of IDs in references
+	bool mapped;   // text is a mailbox image, not a heap copy
+	bool inArena;  // message was allocated from an Arena
 } MailMessageRep;
 
+static MailMessage scanMessage (char **pos, char *end, Arena arena,
+	DateTime date);
+static bool scanHeaders (MailMessage new, char **pos, char *end,
+	bool dated);
+static char *lineEnd (char *line, char *end);
+static char *unfoldField (char *eol, char *end, char **last);
+static uint16_t packIDs (char *value, char *stop);
+static char *fieldStart (char *line, char *eol, size_t skip);
+static char *fieldValue (char *line, char *eol, size_t skip);
+static uint32_t offsetOf (MailMessage mesg, char *p);
+static char *fieldAt (MailMessage mesg, uint32_t off);
+static char *fieldShown (MailMessage mesg, uint32_t off, int *len);
+static void keepLine (char **buf, size_t *len, size_t *max,
+	const char *line, size_t n);
+static void showLine (OutBuf ob, int in, const char *label, size_t len,
+	const char *field, int flen);
+
 // create new Mail Message object
 MailMessage newMailMessage (void)
 {
@@ -33,115 +77,519 @@ MailMessage newMailMessage (void)
 	return new;
 }
 
+// create new Mail Message object in an Arena
+// (a NULL Arena means use malloc, as for newMailMessage)
+MailMessage newMailMessageIn (Arena arena)
+{
+	MailMessageRep *new = ArenaAlloc (arena, sizeof *new);
+	*new = (MailMessageRep) { .inArena = (arena != NULL) };
+	return new;
+}
+
 void dropMailMessage (MailMessage msg)
 {
 	assert (msg != NULL);
+	if (msg->inArena)
+		return; // released along with its Arena
 
-	dropDateTime (msg->date);
-	free (msg->id);
-	free (msg->subject);
-	free (msg->from);
-	free (msg->replyTo);
+	if (! msg->mapped)
+		free (msg->text);
 	free (msg);
 }
 
 // read next Mail Message from open file
 // return NULL if find EOF instead of message
+// lines are read whole, however long, into one buffer that is reused
+// for every line; the message's header lines are copied into another
+// (which becomes the message's text) and read as scanMailMessage does
 MailMessage getMailMessage (FILE *input)
 {
-	char *status;
-	char line[MAXLINE];
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t n;
 
 	// scan until find start of new message or EOF
-	while ((status = fgets (line, MAXLINE, input)) != NULL) {
+	while ((n = getline (&line, &size, input)) >= 0) {
 		// found start of another message
-		if (strncmp (line, "From ", 5) == 0)
+		if (n >= 5 && strncmp (line, "From ", 5) == 0)
 			break;
 	}
-	if (status == NULL)
+	if (n < 0) {
+		free (line);
 		return NULL; // no more messages
+	}
 
 	// make a new empty MailMessage structure
 	MailMessage new = newMailMessage ();
 
-	// scan headers, collecting useful data
-	// - we compare against the first i chars for the header
-	// - we copy from index i+1 to skip the space after the header
-	while (fgets (line, MAXLINE, input) != NULL) {
-		// strip trailing '\n'
-		line[strlen (line) - 1] = '\0';
-		// check if it's one of the interesting header fields
-		if (strncasecmp (line, "Message-ID:", 11) == 0)
-			new->id = strdup (&line[12]);
-		else if (strncasecmp (line, "Subject:", 8) == 0)
-			new->subject = strdup (&line[9]);
-		else if (strncasecmp (line, "From:", 5) == 0)
-			new->from = strdup (&line[6]);
-		else if (strncasecmp (line, "Date:", 5) == 0)
-			new->date = scanDateTime (&line[6]);
-		else if (strncasecmp (line, "In-Reply-To:", 12) == 0)
-			new->replyTo = strdup (&line[13]);
-		else if (strcmp (line, "") == 0)
+	// copy lines, from the "From " line up to and including the blank
+	// line that ends the headers (or up to EOF)
+	char *text = NULL;
+	size_t len = 0, max = 0;
+	do {
+		keepLine (&text, &len, &max, line, (size_t) n);
+		if (line[0] == '\n')
 			break; // end of headers
-		else
-			/* ignore all other headers */;
+	} while ((n = getline (&line, &size, input)) >= 0);
+	free (line);
+	new->text = text;
+
+	// scan headers, collecting useful data
+	// (the body isn't kept; it is skipped by the next call)
+	char *pos = lineEnd (text, text + len) + 1;
+	bool hasDate = scanHeaders (new, &pos, text + len, false);
+	new->body = 0;
+
+	// we MUST have a timestamp for each message
+	assert (hasDate);
+	StatsCount (ST_PARSED, 1);
+	return new;
+}
+
+// read next Mail Message from an in-memory mailbox image
+// scanning starts at *pos and stops before end; *pos is advanced
+// return NULL if find end of image (or it is empty) instead of message
+// - header values are terminated in place (the '\n' becomes '\0'),
+//   and folded ones are unfolded in place (see unfoldField), so the
+//   image must be writable and must end with a '\n'
+// - the message is only valid while the image stays mapped
+//   (and, if allocated from an Arena, until the Arena is dropped)
+MailMessage scanMailMessage (char **pos, char *end, Arena arena)
+{
+	return scanMessage (pos, end, arena, NULL);
+}
+
+// read next Mail Message from an in-memory mailbox image, as for
+// scanMailMessage, giving it a date that is already known
+MailMessage scanMailMessageDated (char **pos, char *end, Arena arena,
+	DateTime date)
+{
+	assert (date != NULL);
+	return scanMessage (pos, end, arena, date);
+}
+
+// read next Mail Message from an in-memory mailbox image
+// (and if date isn't NULL, take its date from there, not Date:)
+// (this function is used only within the ADT)
+static MailMessage scanMessage (char **pos, char *end, Arena arena,
+	DateTime date)
+{
+	char *line, *eol = NULL;
+
+	// scan until find start of new message or end of image
+	// (the body before it is skipped a block at a time)
+	line = *pos;
+	if (line == NULL)
+		return NULL; // empty image
+	if (end - line < 5 || strncmp (line, "From ", 5) != 0) {
+		char *sep = ScanSeparator (line, end);
+		line = (sep == NULL) ? end : sep + 1;
 	}
+	if (line >= end) {
+		*pos = end;
+		return NULL; // no more messages
+	}
+	eol = lineEnd (line, end);
+
+	// make a new empty MailMessage structure
+	MailMessage new = newMailMessageIn (arena);
+	new->mapped = true;
+	new->text = line;
+	new->limit = offsetOf (new, end);
+	if (new->limit == 0)
+		new->limit = UINT32_MAX; // image goes on beyond 4GiB
+
+	// scan headers, collecting useful data
+	*pos = eol + 1;
+	if (date != NULL)
+		new->date = *date;
+	bool hasDate = scanHeaders (new, pos, end, date != NULL);
 
 	// we MUST have a timestamp for each message
-	assert (new->date != NULL);
+	assert (hasDate || date != NULL);
 
-	// after scanning headers, we stop at the start of message body
 	// the message body will be scanned (and skipped) in next call
-
 	return new;
 }
 
-// display Mail Message on stdout with indentation
-static void indent (int n)
+// read header lines starting at *pos (and ending before end),
+// collecting useful data, up to the blank line that ends them
+// *pos is advanced to the body, which follows the blank line (and
+// the body is noted in the message); return whether it had a Date:
+// (if dated, the message already has its date, and Date: is skipped)
+// - we compare against the header name, then skip it and the space
+//   after it to get the value
+// - continuation lines (which start with white space) can only
+//   belong to the field before them, so are ignored unless that is
+//   one we keep, in which case they are joined on to it
+static bool scanHeaders (MailMessage new, char **pos, char *end,
+	bool dated)
+{
+	bool hasDate = false;
+	char *line, *eol;
+	for (line = *pos; line < end; line = eol + 1) {
+		eol = lineEnd (line, end);
+		if (eol == end)
+			break; // unterminated last line; image is malformed
+		size_t len = (size_t) (eol - line);
+		if (len == 0) {
+			line = eol + 1;
+			new->body = offsetOf (new, line);
+			break; // end of headers
+		}
+		size_t skip;
+		HeaderName hdr = ScanHeader (line, len, &skip);
+		if (hdr == HDR_OTHER)
+			continue; // ignore all other headers
+
+		// the field may go on over several lines
+		char *stop = unfoldField (eol, end, &eol);
+		skip++;
+		switch (hdr) {
+		case HDR_MESSAGE_ID:
+			new->id = offsetOf (new, fieldValue (line, stop, skip));
+			break;
+		case HDR_SUBJECT:
+			new->subject = offsetOf (new, fieldStart (line, stop, skip));
+			break;
+		case HDR_FROM:
+			new->from = offsetOf (new, fieldStart (line, stop, skip));
+			break;
+		case HDR_DATE:
+			if (dated)
+				break;
+			hasDate = scanDateTimeInto (fieldValue (line, stop, skip),
+				&new->date);
+			break;
+		case HDR_IN_REPLY_TO:
+			new->replyTo = offsetOf (new, fieldValue (line, stop, skip));
+			break;
+		case HDR_REFERENCES: {
+			char *refs = fieldStart (line, stop, skip);
+			new->nrefs = packIDs (refs, stop);
+			new->references = (new->nrefs > 0) ? offsetOf (new, refs) : 0;
+			break;
+		}
+		case HDR_OTHER:
+			break;
+		}
+	}
+	*pos = (line < end) ? line : end;
+	return hasDate;
+}
+
+// find the '\n' ending the line that starts at line (or end if none)
+static char *lineEnd (char *line, char *end)
+{
+	char *nl = memchr (line, '\n', (size_t) (end - line));
+	return (nl == NULL) ? end : nl;
+}
+
+// join any continuation lines (those starting with a space or tab)
+// on to the header line ending at eol, by moving them up over the
+// '\n's before them (RFC 5322 "unfolding"); return where the joined
+// line now ends, and set *last to the '\n' ending the last line used
+// if any lines were joined, the joined line is '\0'-terminated and
+// the bytes left over after it become spaces, so the header lines
+// that follow are where they were
+static char *unfoldField (char *eol, char *end, char **last)
+{
+	char *to = eol, *nl = eol;
+	while (end - nl > 1 && (nl[1] == ' ' || nl[1] == '\t')) {
+		char *next = lineEnd (nl + 1, end);
+		if (next == end)
+			break; // unterminated; left for scanHeaders
+		size_t n = (size_t) (next - (nl + 1));
+		memmove (to, nl + 1, n);
+		to += n;
+		nl = next;
+	}
+	if (to < nl) {
+		*to = '\0';
+		memset (to + 1, ' ', (size_t) (nl - to - 1));
+	}
+	*last = nl;
+	return to;
+}
+
+// pack the IDs (words starting with '<') in value..stop together at
+// value, each followed by a '\0'; other words (e.g. comments) are
+// dropped; return the number of IDs (at most UINT16_MAX are kept)
+// - each word is followed by a separator, or by stop, which the '\0'
+//   can go over, so the packed IDs never overtake the ones to come
+static uint16_t packIDs (char *value, char *stop)
+{
+	char *to = value, *p = value;
+	uint16_t n = 0;
+	while (p < stop && n < UINT16_MAX) {
+		while (p < stop && isspace ((unsigned char) *p))
+			p++;
+		char *word = p;
+		while (p < stop && ! isspace ((unsigned char) *p))
+			p++;
+		size_t len = (size_t) (p - word);
+		if (p < stop)
+			p++; // past the separator
+		if (len == 0 || word[0] != '<')
+			continue;
+		memmove (to, word, len);
+		to += len;
+		*to++ = '\0';
+		n++;
+	}
+	return n;
+}
+
+// find value of header line, which runs up to eol
+// (skip chars of header name plus the space that follows it)
+static char *fieldStart (char *line, char *eol, size_t skip)
+{
+	return (line + skip <= eol) ? line + skip : eol;
+}
+
+// terminate header line in place and return its value
+static char *fieldValue (char *line, char *eol, size_t skip)
+{
+	*eol = '\0';
+	return fieldStart (line, eol, skip);
+}
+
+// offset of p in message's text
+// (0, i.e. missing, if it is too far in to be recorded)
+static uint32_t offsetOf (MailMessage mesg, char *p)
+{
+	size_t off = (size_t) (p - mesg->text);
+	return (off <= UINT32_MAX) ? (uint32_t) off : 0;
+}
+
+// header field at offset off in message's text (NULL if missing)
+static char *fieldAt (MailMessage mesg, uint32_t off)
+{
+	return (off == 0) ? NULL : mesg->text + off;
+}
+
+// header field at offset off, and its length, for display
+// (a field ends at '\0', or at '\n' if not yet terminated;
+// missing fields are shown as "(null)")
+static char *fieldShown (MailMessage mesg, uint32_t off, int *len)
+{
+	char *field = (off == 0) ? "(null)" : mesg->text + off;
+	*len = (int) strcspn (field, "\n");
+	return field;
+}
+
+// append a line of n chars to a growable buffer
+// (a '\n' is added if it doesn't end with one, e.g. at EOF)
+static void keepLine (char **buf, size_t *len, size_t *max,
+	const char *line, size_t n)
 {
-	int i;
-	for (i = 0; i < n; i++)
-		putchar (' ');
+	if (*len + n + 1 > *max) {
+		while (*len + n + 1 > *max)
+			*max = (*max == 0) ? 1024 : 2 * *max;
+		*buf = realloc (*buf, *max);
+		if (*buf == NULL) err (EX_OSERR, "couldn't allocate MailMessage");
+	}
+	memcpy (*buf + *len, line, n);
+	*len += n;
+	if (n == 0 || line[n - 1] != '\n')
+		(*buf)[(*len)++] = '\n';
 }
 
+// display Mail Message on stdout with indentation
+// (formatted into a buffer first, then written with one call, so
+// messages shown from different threads never interleave)
 void showMailMessage (MailMessage mesg, int nsp)
 {
 	assert (mesg != NULL);
-	indent (3 * nsp);
-	printf ("/----------\n");
-	indent (3 * nsp);
-	printf ("| M-ID: %s\n", mesg->id);
-	indent (3 * nsp);
-	printf ("| Subj: %s\n", mesg->subject);
-	indent (3 * nsp);
-	printf ("| From: %s\n", mesg->from);
-	// no \n for date because ctime gives one
-	indent (3 * nsp);
-	printf ("| Date: ");
-	showDateTime (mesg->date);
-	indent (3 * nsp);
-	printf ("| Repl: %s\n", mesg->replyTo);
-	indent (3 * nsp);
-	printf ("\\----------\n");
+	char local[1024];
+	char *buf = local;
+	size_t len = (size_t) showMailMessageTo (local, sizeof local, mesg, nsp);
+	if (len >= sizeof local) {
+		buf = malloc (len + 1);
+		if (buf == NULL) err (EX_OSERR, "couldn't allocate MailMessage text");
+		showMailMessageTo (buf, len + 1, mesg, nsp);
+	}
+	fwrite (buf, 1, len, stdout);
+	if (buf != local)
+		free (buf);
+}
+
+// format Mail Message, as for showMailMessage, into a buffer
+// same conventions as snprintf: at most size bytes are written
+// (including the '\0'), and the full length of the text is returned
+int showMailMessageTo (char *buf, size_t size, MailMessage mesg, int nsp)
+{
+	assert (mesg != NULL);
+	char date[DATETIME_LEN];
+	showDateTimeTo (date, sizeof date, &mesg->date, mesg->date.zone);
+
+	int idLen, subjLen, fromLen, replLen;
+	char *id = fieldShown (mesg, mesg->id, &idLen);
+	char *subj = fieldShown (mesg, mesg->subject, &subjLen);
+	char *from = fieldShown (mesg, mesg->from, &fromLen);
+	char *repl = fieldShown (mesg, mesg->replyTo, &replLen);
+
+	// "%*s" with "" gives the indentation
+	int in = 3 * nsp;
+	return snprintf (buf, size,
+		"%*s/----------\n"
+		"%*s| M-ID: %.*s\n"
+		"%*s| Subj: %.*s\n"
+		"%*s| From: %.*s\n"
+		"%*s| Date: %s" // no \n for date because showDateTimeTo gives one
+		"%*s| Repl: %.*s\n"
+		"%*s\\----------\n",
+		in, "",
+		in, "", idLen, id,
+		in, "", subjLen, subj,
+		in, "", fromLen, from,
+		in, "", date,
+		in, "", replLen, repl,
+		in, "");
+}
+
+// append Mail Message (with indentation) to an output buffer
+// same text as showMailMessageTo, but built with memcpy's into the
+// buffer (only the date goes through the printf machinery)
+void showMailMessageOn (OutBuf ob, MailMessage mesg, int nsp)
+{
+	assert (mesg != NULL);
+	int in = 3 * nsp, flen;
+	char *field;
+	showLine (ob, in, "/----------\n", 12, NULL, 0);
+	field = fieldShown (mesg, mesg->id, &flen);
+	showLine (ob, in, "| M-ID: ", 8, field, flen);
+	field = fieldShown (mesg, mesg->subject, &flen);
+	showLine (ob, in, "| Subj: ", 8, field, flen);
+	field = fieldShown (mesg, mesg->from, &flen);
+	showLine (ob, in, "| From: ", 8, field, flen);
+	showLine (ob, in, "| Date: ", 8, NULL, 0);
+	char *date = OutBufReserve (ob, DATETIME_LEN);
+	OutBufCommit (ob, (size_t) showDateTimeTo (date, DATETIME_LEN,
+		&mesg->date, mesg->date.zone));
+	field = fieldShown (mesg, mesg->replyTo, &flen);
+	showLine (ob, in, "| Repl: ", 8, field, flen);
+	showLine (ob, in, "\\----------\n", 12, NULL, 0);
+}
+
+// append one line of a displayed message: indent, label, field, "\n"
+// (if field is NULL, only the indent and label are written)
+static void showLine (OutBuf ob, int in, const char *label, size_t len,
+	const char *field, int flen)
+{
+	OutBufIndent (ob, in);
+	OutBufWrite (ob, label, len);
+	if (field != NULL) {
+		OutBufWrite (ob, field, (size_t) flen);
+		OutBufWrite (ob, "\n", 1);
+	}
 }
 
 // get ID of mail message
 char *MailMessageID (MailMessage mesg)
 {
 	assert (mesg != NULL);
-	return mesg->id;
+	return fieldAt (mesg, mesg->id);
+}
+
+// get subject of mail message
+// (the field is terminated in place the first time it is asked for)
+char *MailMessageSubject (MailMessage mesg)
+{
+	assert (mesg != NULL);
+	char *subject = fieldAt (mesg, mesg->subject);
+	if (subject != NULL)
+		subject[strcspn (subject, "\n")] = '\0';
+	return subject;
+}
+
+// get sender of mail message
+// (the field is terminated in place the first time it is asked for)
+char *MailMessageFrom (MailMessage mesg)
+{
+	assert (mesg != NULL);
+	char *from = fieldAt (mesg, mesg->from);
+	if (from != NULL)
+		from[strcspn (from, "\n")] = '\0';
+	return from;
+}
+
+// get body of mail message, and set *len to its length
+// the body runs from the line after the headers up to the next
+// "From " line (or the end of the mailbox image)
+char *MailMessageBody (MailMessage mesg, size_t *len)
+{
+	assert (mesg != NULL && len != NULL);
+	*len = 0;
+	if (mesg->body == 0)
+		return NULL;
+
+	// the blank line before the body still ends in '\n'
+	char *body = mesg->text + mesg->body;
+	char *next = ScanSeparator (body - 1, mesg->text + mesg->limit);
+	*len = (next == NULL) ?
+		(size_t) (mesg->limit - mesg->body) : (size_t) (next + 1 - body);
+	return body;
 }
 
 // get timestamp of mail message
 DateTime MailMessageDateTime (MailMessage mesg)
 {
 	assert (mesg != NULL);
-	return mesg->date;
+	return &mesg->date;
+}
+
+// get timestamp of mail message, as a plain value
+Timestamp MailMessageTimestamp (MailMessage mesg)
+{
+	assert (mesg != NULL);
+	return mesg->date.timestamp;
 }
 
 // get in-reply-to field of mail message
 char *MailMessageRepliesTo (MailMessage mesg)
 {
 	assert (mesg != NULL);
-	return mesg->replyTo;
+	return fieldAt (mesg, mesg->replyTo);
+}
+
+// get IDs in references field of mail message, and set *n to how
+// many there are (they follow one another, each ending in '\0')
+char *MailMessageReferences (MailMessage mesg, size_t *n)
+{
+	assert (mesg != NULL && n != NULL);
+	*n = mesg->nrefs;
+	return fieldAt (mesg, mesg->references);
+}
+
+// give the message's ID and In-Reply-To ID their handles in an
+// IDTable (done once: a message belongs to a single IDTable)
+void MailMessageIntern (MailMessage mesg, IDTable ids)
+{
+	assert (mesg != NULL && ids != NULL);
+	if (mesg->idKey == NO_MSGID)
+		mesg->idKey = IDTableIntern (ids, fieldAt (mesg, mesg->id));
+	if (mesg->replyKey == NO_MSGID)
+		mesg->replyKey = IDTableIntern (ids, fieldAt (mesg, mesg->replyTo));
+}
+
+// get interned ID of mail message (NO_MSGID if none, or not interned)
+MsgID MailMessageIDKey (MailMessage mesg)
+{
+	assert (mesg != NULL);
+	return mesg->idKey;
+}
+
+// get interned in-reply-to ID of mail message (as for MailMessageIDKey)
+MsgID MailMessageRepliesToKey (MailMessage mesg)
+{
+	assert (mesg != NULL);
+	return mesg->replyKey;
+}
+
+// get start of mail message in the mailbox image it was read from
+char *MailMessageText (MailMessage mesg)
+{
+	assert (mesg != NULL);
+	return mesg->mapped ? mesg->text : NULL;
 }
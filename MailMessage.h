@@ -7,7 +7,10 @@
 #include <stdio.h>
 #include <time.h>
 
+#include "Arena.h"
 #include "DateTime.h"
+#include "IDTable.h"
+#include "OutBuf.h"
 
 // External view of MailMessage
 
@@ -16,23 +19,91 @@ typedef struct MailMessageRep* MailMessage;
 // create new Mail Message object
 MailMessage newMailMessage (void);
 
+// create new Mail Message object in an Arena
+// (it is released by dropArena; dropMailMessage ignores it)
+MailMessage newMailMessageIn (Arena);
+
 // free up memory associated with mail message
 void dropMailMessage (MailMessage);
 
 // read next Mail Message from open file
 // return NULL if find EOF instead of message
+// (lines can be any length; header fields folded over several lines
+// are unfolded, as for scanMailMessage)
 MailMessage getMailMessage (FILE *);
 
+// note: getMailMessage shares the FILE (and its lock) with anything
+// else using it; threads should each use their own MailBox instead
+// (MailBoxNext, or scanMailMessage below, takes the place of a
+// getMailMessageFrom(reader) that reads from a per-thread reader)
+
+// read next Mail Message from an in-memory mailbox image
+// scanning starts at *pos and stops before end; *pos is advanced
+// header fields are views into the (writable) image, not copies
+// (a field folded over several lines is unfolded in place)
+// the message (and its timestamp) is allocated from the Arena
+// return NULL if find end of image instead of message
+MailMessage scanMailMessage (char **, char *, Arena);
+
+// as for scanMailMessage, but for a message whose date is already
+// known (e.g. from an index): its "Date:" field isn't parsed
+MailMessage scanMailMessageDated (char **, char *, Arena, DateTime);
+
 // display Mail Message on stdout (with indentation)
 void showMailMessage (MailMessage, int);
 
+// format Mail Message (with indentation) into a buffer, as snprintf
+// returns length of full text, even if buffer was too small
+// (reentrant: for use from multiple threads, or to build output)
+int showMailMessageTo (char *, size_t, MailMessage, int);
+
+// append Mail Message (with indentation) to an output buffer
+// (same text as showMailMessage; for rendering many messages)
+void showMailMessageOn (OutBuf, MailMessage, int);
+
 // get ID of mail message
 char *MailMessageID (MailMessage);
 
+// get subject of mail message
+char *MailMessageSubject (MailMessage);
+
+// get sender ("From:" field) of mail message
+char *MailMessageFrom (MailMessage);
+
+// get body of mail message, and its length (it is not '\0'-terminated)
+// return NULL (and length 0) if the body wasn't kept (getMailMessage)
+char *MailMessageBody (MailMessage, size_t *);
+
 // get timestamp of mail message
+// (the DateTime is part of the message: don't drop it separately)
 DateTime MailMessageDateTime (MailMessage);
 
+// get timestamp of mail message, as a plain value
+Timestamp MailMessageTimestamp (MailMessage);
+
 // get in-reply-to field of mail message
 char *MailMessageRepliesTo (MailMessage);
 
+// get IDs in references field of mail message, and how many there
+// are; the IDs follow one another, oldest first, each ending in '\0'
+// (words in the field that aren't "<...>" IDs are left out)
+// return NULL (and 0) if the message has no references
+char *MailMessageReferences (MailMessage, size_t *);
+
+// give the message's ID and In-Reply-To ID handles in an IDTable
+// (a message can only be interned in one IDTable; MailBox does this
+// for every message it reads)
+void MailMessageIntern (MailMessage, IDTable);
+
+// get handle of ID of mail message
+// (NO_MSGID if it has no ID, or hasn't been interned)
+MsgID MailMessageIDKey (MailMessage);
+
+// get handle of in-reply-to field of mail message (as above)
+MsgID MailMessageRepliesToKey (MailMessage);
+
+// get start of mail message (its "From " line) in the mailbox image
+// return NULL if the message was not read by scanMailMessage
+char *MailMessageText (MailMessage);
+
 #endif
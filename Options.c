@@ -0,0 +1,43 @@
+// Options.c ... command line options of the task programs
+
+#include <err.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sysexits.h>
+#include <unistd.h>
+
+#include "Options.h"
+#include "Stats.h"
+
+// process command line args (see Options.h)
+Options parseOptions (int argc, char *argv[], bool refs)
+{
+	Options opts = { .nthreads = 1 };
+	static struct option longopts[] = {
+		{ "stats", no_argument, NULL, 'S' },
+		{ NULL, 0, NULL, 0 }
+	};
+	char *env = getenv ("MAILBOX_STATS");
+	if (env != NULL && *env != '\0' && *env != '0')
+		StatsEnable ();
+	int opt;
+	while ((opt = getopt_long (argc, argv, refs ? "ij:r" : "ij:",
+			longopts, NULL)) != -1) {
+		if (opt == 'i')
+			opts.useIndex = true;
+		else if (opt == 'j')
+			opts.nthreads = atoi (optarg);
+		else if (opt == 'r')
+			opts.useRefs = true;
+		else if (opt == 'S')
+			StatsEnable ();
+		else
+			argc = 0; // force usage message
+	}
+	if (argc - optind != 1)
+		errx (EX_USAGE, "usage: %s [-i] [-j threads]%s [--stats] <mailbox>",
+			argv[0], refs ? " [-r]" : "");
+	opts.mailbox = argv[optind];
+	return opts;
+}
@@ -0,0 +1,29 @@
+// Options.h ... command line options of the task programs
+// task1, task2 and task3 all take
+//     [-i] [-j threads] [--stats] <mailbox>
+// and task3 also takes -r:
+//     -i keeps an index of the mailbox in <mailbox>.idx
+//     -j N parses the mailbox on N threads (0 = one per CPU)
+//     -r threads by References (and In-Reply-To), grouping replies
+//        to messages that aren't in the mailbox
+//     --stats (or MAILBOX_STATS=1 in the environment) writes timings
+//        and counters to stderr, as JSON
+
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <stdbool.h>
+
+typedef struct Options {
+	char *mailbox;		// mailbox file to read
+	bool useIndex;		// -i: use sidecar index?
+	int nthreads;		// -j: parser threads
+	bool useRefs;		// -r: thread by References?
+} Options;
+
+// process command line args (refs says whether -r is allowed),
+// switching on statistics if they are asked for
+// (exits with a usage message if the args are wrong)
+Options parseOptions (int, char *[], bool refs);
+
+#endif
@@ -0,0 +1,104 @@
+// OutBuf.c ... implementation of buffered Output ADT
+
+#include <assert.h>
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+
+#include "OutBuf.h"
+
+#define OUTBUF_SIZE (256 * 1024)
+
+// data structures representing OutBuf
+
+typedef struct OutBufRep {
+	FILE *out;	 // where text goes
+	char *buf;	 // buffered text
+	size_t used; // number of bytes in buf
+	size_t size; // capacity of buf
+} OutBufRep;
+
+// spaces for OutBufIndent, copied in chunks rather than one at a time
+static const char spaces[] =
+	"                                                                "
+	"                                                                ";
+
+// create a new empty output buffer, writing to an open FILE
+OutBuf newOutBuf (FILE *out)
+{
+	assert (out != NULL);
+	OutBufRep *new = malloc (sizeof *new);
+	if (new == NULL) err (EX_OSERR, "couldn't allocate OutBuf");
+	*new = (OutBufRep) { .out = out, .size = OUTBUF_SIZE };
+	new->buf = malloc (new->size);
+	if (new->buf == NULL) err (EX_OSERR, "couldn't allocate OutBuf buffer");
+	return new;
+}
+
+// write out anything still buffered, then free output buffer
+void dropOutBuf (OutBuf ob)
+{
+	assert (ob != NULL);
+	OutBufFlush (ob);
+	free (ob->buf);
+	free (ob);
+}
+
+// write out everything buffered so far
+void OutBufFlush (OutBuf ob)
+{
+	assert (ob != NULL);
+	if (ob->used > 0 && fwrite (ob->buf, 1, ob->used, ob->out) != ob->used)
+		err (EX_IOERR, "couldn't write output");
+	ob->used = 0;
+}
+
+// make room for (at least) n more bytes of text
+char *OutBufReserve (OutBuf ob, size_t n)
+{
+	assert (ob != NULL);
+	if (ob->size - ob->used < n) {
+		OutBufFlush (ob);
+		if (ob->size < n) {
+			ob->size = n;
+			ob->buf = realloc (ob->buf, ob->size);
+			if (ob->buf == NULL)
+				err (EX_OSERR, "couldn't allocate OutBuf buffer");
+		}
+	}
+	return &ob->buf[ob->used];
+}
+
+// count n bytes written at OutBufReserve's pointer as buffered text
+void OutBufCommit (OutBuf ob, size_t n)
+{
+	assert (ob != NULL);
+	assert (n <= ob->size - ob->used);
+	ob->used += n;
+}
+
+// append n bytes of text to output buffer
+void OutBufWrite (OutBuf ob, const char *text, size_t n)
+{
+	memcpy (OutBufReserve (ob, n), text, n);
+	ob->used += n;
+}
+
+// append a string to output buffer
+void OutBufPuts (OutBuf ob, const char *text)
+{
+	OutBufWrite (ob, text, strlen (text));
+}
+
+// append n spaces to output buffer
+void OutBufIndent (OutBuf ob, int n)
+{
+	while (n > 0) {
+		size_t chunk = ((size_t) n < sizeof spaces - 1) ?
+			(size_t) n : sizeof spaces - 1;
+		OutBufWrite (ob, spaces, chunk);
+		n -= (int) chunk;
+	}
+}
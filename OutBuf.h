@@ -0,0 +1,40 @@
+// OutBuf.h ... interface to buffered Output ADT
+// Text is accumulated in a large buffer and written to the underlying
+// FILE in big blocks, with one fwrite per block.
+
+#ifndef OUTBUF_H
+#define OUTBUF_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// External view of OutBuf
+
+typedef struct OutBufRep *OutBuf;
+
+// create a new empty output buffer, writing to an open FILE
+OutBuf newOutBuf (FILE *);
+
+// write out anything still buffered, then free output buffer
+void dropOutBuf (OutBuf);
+
+// write out everything buffered so far
+void OutBufFlush (OutBuf);
+
+// append n bytes of text to output buffer
+void OutBufWrite (OutBuf, const char *, size_t);
+
+// append a string to output buffer
+void OutBufPuts (OutBuf, const char *);
+
+// append n spaces to output buffer
+void OutBufIndent (OutBuf, int);
+
+// make room for (at least) n more bytes of text, and return where
+// they go; the caller fills in some of them and calls OutBufCommit
+char *OutBufReserve (OutBuf, size_t);
+
+// count n bytes written at OutBufReserve's pointer as buffered text
+void OutBufCommit (OutBuf, size_t);
+
+#endif
@@ -0,0 +1,203 @@
+// Scan.c ... fast scanning of mailbox text
+// A "From " line is found by looking for '\n' followed by 'F' in a
+// whole vector of bytes at once (the '\n's compared with one load,
+// the 'F's with another one byte further on), and only checking the
+// rest of "From " where both match; so skipping a message body costs
+// a couple of compares per 16 or 32 bytes, not a call per line.
+// AVX2 is used if the CPU has it (checked at run time), else SSE2
+// (always there on x86-64), else memchr from one '\n' to the next.
+//
+// Header names are matched by comparing one or two 8-byte words of
+// the line with the name, after setting the case bit (0x20) in the
+// letter positions only, so that nothing but the name's letters in
+// either case (and its other chars exactly) can match.
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "Scan.h"
+
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+static char *scanPlain (char *p, char *end);
+#ifdef SCAN_X86
+static char *scanAVX2 (char *p, char *end);
+#endif
+#ifdef __SSE2__
+static char *scanSSE2 (char *p, char *end);
+#endif
+static inline bool matchName (const char *line, const char *name, size_t n);
+static inline uint64_t word (const char *p, size_t n);
+static inline uint64_t foldMask (const char *name, size_t n);
+
+// find the first "\nFrom " in p..end
+char *ScanSeparator (char *p, char *end)
+{
+	assert (p != NULL && p <= end);
+#ifdef SCAN_X86
+	if (__builtin_cpu_supports ("avx2"))
+		return scanAVX2 (p, end);
+#endif
+#ifdef __SSE2__
+	return scanSSE2 (p, end);
+#else
+	return scanPlain (p, end);
+#endif
+}
+
+// find "\nFrom " one line at a time
+// (also finishes off the last few bytes for the vector versions)
+// (this function is used only within the ADT)
+static char *scanPlain (char *p, char *end)
+{
+	for (; p < end; p++) {
+		p = memchr (p, '\n', (size_t) (end - p));
+		if (p == NULL)
+			return NULL;
+		if (end - p >= 6 && memcmp (p + 1, "From ", 5) == 0)
+			return p;
+	}
+	return NULL;
+}
+
+#ifdef SCAN_X86
+// find "\nFrom " 32 bytes at a time
+// (a candidate at the last of the 32 bytes still has its "rom "
+// inside the image, since the loop stops 5 bytes short of end;
+// loads go through memcpy, which compiles to one unaligned load)
+// (this function is used only within the ADT)
+__attribute__ ((target ("avx2")))
+static char *scanAVX2 (char *p, char *end)
+{
+	const __m256i nl = _mm256_set1_epi8 ('\n');
+	const __m256i f = _mm256_set1_epi8 ('F');
+	while (end - p >= 32 + 5) {
+		__m256i a, b;
+		memcpy (&a, p, sizeof a);
+		memcpy (&b, p + 1, sizeof b);
+		uint32_t hits = (uint32_t) _mm256_movemask_epi8 (_mm256_and_si256 (
+			_mm256_cmpeq_epi8 (a, nl), _mm256_cmpeq_epi8 (b, f)));
+		for (; hits != 0; hits &= hits - 1) {
+			char *q = p + __builtin_ctz (hits);
+			if (memcmp (q + 2, "rom ", 4) == 0)
+				return q;
+		}
+		p += 32;
+	}
+	return scanPlain (p, end);
+}
+#endif
+
+#ifdef __SSE2__
+// find "\nFrom " 16 bytes at a time (as for scanAVX2)
+// (this function is used only within the ADT)
+static char *scanSSE2 (char *p, char *end)
+{
+	const __m128i nl = _mm_set1_epi8 ('\n');
+	const __m128i f = _mm_set1_epi8 ('F');
+	while (end - p >= 16 + 5) {
+		__m128i a, b;
+		memcpy (&a, p, sizeof a);
+		memcpy (&b, p + 1, sizeof b);
+		uint32_t hits = (uint32_t) _mm_movemask_epi8 (_mm_and_si128 (
+			_mm_cmpeq_epi8 (a, nl), _mm_cmpeq_epi8 (b, f)));
+		for (; hits != 0; hits &= hits - 1) {
+			char *q = p + __builtin_ctz (hits);
+			if (memcmp (q + 2, "rom ", 4) == 0)
+				return q;
+		}
+		p += 16;
+	}
+	return scanPlain (p, end);
+}
+#endif
+
+// which header field does a line start with?
+// (the first char picks the one name it could be, so each line
+// costs at most one compare)
+HeaderName ScanHeader (const char *line, size_t len, size_t *skip)
+{
+	assert (line != NULL && skip != NULL);
+	*skip = 0;
+	if (len == 0)
+		return HDR_OTHER;
+
+	HeaderName hdr = HDR_OTHER;
+	switch (line[0] | 0x20) {
+	case 'm':
+		if (len >= 11 && matchName (line, "message-id:", 11)) {
+			hdr = HDR_MESSAGE_ID;
+			*skip = 11;
+		}
+		break;
+	case 's':
+		if (len >= 8 && matchName (line, "subject:", 8)) {
+			hdr = HDR_SUBJECT;
+			*skip = 8;
+		}
+		break;
+	case 'f':
+		if (len >= 5 && matchName (line, "from:", 5)) {
+			hdr = HDR_FROM;
+			*skip = 5;
+		}
+		break;
+	case 'd':
+		if (len >= 5 && matchName (line, "date:", 5)) {
+			hdr = HDR_DATE;
+			*skip = 5;
+		}
+		break;
+	case 'i':
+		if (len >= 12 && matchName (line, "in-reply-to:", 12)) {
+			hdr = HDR_IN_REPLY_TO;
+			*skip = 12;
+		}
+		break;
+	case 'r':
+		if (len >= 11 && matchName (line, "references:", 11)) {
+			hdr = HDR_REFERENCES;
+			*skip = 11;
+		}
+		break;
+	}
+	return hdr;
+}
+
+// does line start with name (n chars, lower case, at most 16),
+// ignoring the case of its letters?
+// (names longer than 8 are compared as two overlapping words)
+// (this function is used only within the ADT)
+static inline bool matchName (const char *line, const char *name, size_t n)
+{
+	if (n <= 8)
+		return (word (line, n) | foldMask (name, n)) == word (name, n);
+	size_t last = n - 8;
+	return (word (line, 8) | foldMask (name, 8)) == word (name, 8) &&
+		(word (line + last, 8) | foldMask (name + last, 8)) ==
+			word (name + last, 8);
+}
+
+// first n (<= 8) chars at p, as a word
+// (this function is used only within the ADT)
+static inline uint64_t word (const char *p, size_t n)
+{
+	uint64_t w = 0;
+	memcpy (&w, p, n);
+	return w;
+}
+
+// word with 0x20 in the places of the letters among n chars of name
+// (the only chars in the names are lower-case letters, '-' and ':',
+// and only the letters have the 0x40 bit set; as name is a constant,
+// the compiler works this out)
+// (this function is used only within the ADT)
+static inline uint64_t foldMask (const char *name, size_t n)
+{
+	return (word (name, n) & 0x4040404040404040) >> 1;
+}
@@ -0,0 +1,31 @@
+// Scan.h ... interface to fast scanning of mailbox text
+// Finds "From " lines a block of bytes at a time (with AVX2 or SSE2
+// where the CPU has them, else a plain memchr loop), and recognises
+// the header fields that MailMessage keeps.
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+
+// header fields of interest
+typedef enum {
+	HDR_OTHER,		// any other header line
+	HDR_MESSAGE_ID,		// "Message-ID:"
+	HDR_SUBJECT,		// "Subject:"
+	HDR_FROM,		// "From:"
+	HDR_DATE,		// "Date:"
+	HDR_IN_REPLY_TO,	// "In-Reply-To:"
+	HDR_REFERENCES		// "References:"
+} HeaderName;
+
+// find the first "\nFrom " in p..end (i.e. the '\n' before the next
+// "From " line that starts after p); return NULL if there isn't one
+char *ScanSeparator (char *p, char *end);
+
+// which header field does a line of len chars start with?
+// (names are matched ignoring case; *skip is set to the length of
+// the name, including its ':')
+HeaderName ScanHeader (const char *line, size_t len, size_t *skip);
+
+#endif
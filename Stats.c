@@ -0,0 +1,106 @@
+// Stats.c ... implementation of run-time statistics
+// Counters live in one global array; phases are kept in a small
+// fixed table, since a run only has a handful of them.
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "Stats.h"
+
+#define MAX_PHASES 16
+
+bool statsEnabled = false;
+_Atomic unsigned long long statsCounts[N_STATS];
+
+// phases timed so far
+static struct {
+	const char *name;
+	double secs;
+} phases[MAX_PHASES];
+static int nphases = 0;
+static double phaseStart;	// when the current phase started
+static double startTime;	// when StatsEnable was called
+
+static double now (void);
+static double ratio (StatCounter num, StatCounter den);
+
+// switch on collection
+void StatsEnable (void)
+{
+	statsEnabled = true;
+	startTime = now ();
+}
+
+// set a counter to a value
+void StatsSet (StatCounter c, unsigned long long value)
+{
+	if (statsEnabled)
+		atomic_store_explicit (&statsCounts[c], value,
+			memory_order_relaxed);
+}
+
+// end the current phase (if any) and start a new one
+void StatsPhase (const char *name)
+{
+	if (! statsEnabled)
+		return;
+	double t = now ();
+	if (nphases > 0 && phases[nphases - 1].secs < 0)
+		phases[nphases - 1].secs = t - phaseStart;
+	if (name == NULL || nphases == MAX_PHASES)
+		return;
+	phases[nphases].name = name;
+	phases[nphases++].secs = -1; // still running
+	phaseStart = t;
+}
+
+// write all statistics as one JSON object
+void StatsReport (FILE *out)
+{
+	assert (out != NULL);
+	if (! statsEnabled)
+		return;
+	StatsPhase (NULL);
+
+#define COUNT(c) atomic_load_explicit (&statsCounts[c], memory_order_relaxed)
+	fprintf (out, "{\"seconds\": %.6f, \"phases\": {", now () - startTime);
+	for (int i = 0; i < nphases; i++)
+		fprintf (out, "%s\"%s\": %.6f", (i == 0) ? "" : ", ",
+			phases[i].name, phases[i].secs);
+	fprintf (out, "}, ");
+	fprintf (out, "\"messages\": {\"parsed\": %llu, \"skipped\": %llu}, ",
+		COUNT (ST_PARSED), COUNT (ST_SKIPPED));
+	fprintf (out, "\"list\": {\"inserts\": %llu, \"steps\": %llu, "
+		"\"stepsPerInsert\": %.2f}, ", COUNT (ST_LIST_INSERTS),
+		COUNT (ST_LIST_STEPS), ratio (ST_LIST_STEPS, ST_LIST_INSERTS));
+	unsigned long long treeOps = COUNT (ST_TREE_INSERTS) + COUNT (ST_TREE_FINDS);
+	fprintf (out, "\"tree\": {\"inserts\": %llu, \"finds\": %llu, "
+		"\"compares\": %llu, \"comparesPerOp\": %.2f, \"depth\": %llu}, ",
+		COUNT (ST_TREE_INSERTS), COUNT (ST_TREE_FINDS),
+		COUNT (ST_TREE_COMPARES), (treeOps == 0) ? 0 :
+			(double) COUNT (ST_TREE_COMPARES) / (double) treeOps,
+		COUNT (ST_TREE_DEPTH));
+	fprintf (out, "\"thread\": {\"adds\": %llu, \"visits\": %llu, "
+		"\"visitsPerAdd\": %.2f}}\n", COUNT (ST_THREAD_ADDS),
+		COUNT (ST_THREAD_VISITS), ratio (ST_THREAD_VISITS, ST_THREAD_ADDS));
+#undef COUNT
+	fflush (out);
+}
+
+// current time (seconds)
+static double now (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+// one counter divided by another (0 if the second is 0)
+static double ratio (StatCounter num, StatCounter den)
+{
+	unsigned long long d = atomic_load (&statsCounts[den]);
+	return (d == 0) ? 0 : (double) atomic_load (&statsCounts[num]) / (double) d;
+}
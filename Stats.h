@@ -0,0 +1,57 @@
+// Stats.h ... interface to run-time statistics (counters and timers)
+// Collection is off unless StatsEnable is called, and then costs a
+// relaxed atomic add per counted event; when off, it costs one
+// well-predicted test of a flag.  Counters can be updated from any
+// thread (e.g. MailBox parser threads).
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// things that are counted
+typedef enum {
+	ST_PARSED,		// messages whose headers were read
+	ST_SKIPPED,		// ... of which bodies were skipped unread, as
+				// the index gave their starts (no message
+				// is ever left out altogether)
+	ST_LIST_INSERTS,	// messages put into an MMList
+	ST_LIST_STEPS,		// nodes passed / keys compared doing so
+	ST_TREE_INSERTS,	// MMTreeInsert calls
+	ST_TREE_FINDS,		// MMTreeFind calls
+	ST_TREE_COMPARES,	// IDs compared (or slots probed) by them
+	ST_TREE_DEPTH,		// MMTreeDepth (set, not added; see MMTree.h)
+	ST_THREAD_ADDS,		// messages added to a ThreadTree
+	ST_THREAD_VISITS,	// nodes looked at while adding them
+	N_STATS
+} StatCounter;
+
+// (these are only for StatsCount: use the functions below)
+extern bool statsEnabled;
+extern _Atomic unsigned long long statsCounts[N_STATS];
+
+// switch on collection (and note the start time)
+void StatsEnable (void);
+
+// add n to a counter
+static inline void StatsCount (StatCounter c, unsigned long long n)
+{
+	if (statsEnabled)
+		atomic_fetch_add_explicit (&statsCounts[c], n,
+			memory_order_relaxed);
+}
+
+// set a counter to a value (for things measured, not counted)
+void StatsSet (StatCounter, unsigned long long);
+
+// end the current phase (if any), and start a new one with the
+// given name (NULL: just end the current phase)
+// each phase's wall-clock time is included in the report
+void StatsPhase (const char *);
+
+// write all statistics as one JSON object (and a newline)
+void StatsReport (FILE *);
+
+#endif
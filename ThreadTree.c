@@ -9,57 +9,104 @@
 #include <string.h>
 #include <sysexits.h>
 #include <stdbool.h>
+#include <stdint.h>
 
+#include "Arena.h"
+#include "IDTable.h"
 #include "MMList.h"
 #include "MMTree.h"
 #include "MailMessage.h"
+#include "OutBuf.h"
+#include "Stats.h"
 #include "ThreadTree.h"
 
-typedef struct QueueRep *Queue;
 typedef struct ThreadTreeNode *Link;
 
-//Queue Structs 
-typedef struct QueueNode {
-	Link value;
-	struct QueueNode *next;
-} QueueNode;
-
-typedef struct QueueRep {
-	QueueNode *head; // ptr to first node
-	QueueNode *tail; // ptr to last node
-} QueueRep;
-
-
 // ThreadTree Structs
+// every list (top-level threads, and each node's replies) is kept in
+// thread order: timestamp, then order of arrival for equal timestamps
+// a node with no message stands for a message that isn't in the
+// mailbox, but which two or more top-level threads reply to (this
+// only happens in trees made by ThreadTreeBuildRefs)
 typedef struct ThreadTreeNode {
-	MailMessage mesg;
-	Link next, replies;
+	MailMessage mesg; // the message (NULL if missing, see above)
+	Timestamp key;	// timestamp of message (copied, for fast compares)
+	uint32_t seq;	// arrival number (breaks ties on key)
+	MsgID missing;	// ID of missing message (if mesg is NULL)
+	Link next, prev;
+	Link replies;
+	Link lastReply; // last node in replies list (for O(1) append)
+	Link parent;	// node this is a reply to (NULL at top level)
+	Link waiting;	// next top-level node waiting for the same parent
 } ThreadTreeNode;
 
+// IDEntry: for each interned Message-ID (see IDTable), the
+// ThreadTree node holding it, and the top-level nodes that are
+// replies to it, if it hasn't been seen yet
+// the entries are an array indexed by the ID's handle (MsgID)
+typedef struct IDEntry {
+	Link node;	// (first) node with this ID, or NULL if not yet seen
+	Link waiting;	// nodes replying to this ID, waiting for it to arrive
+} IDEntry;
+
+// Container: what ThreadTreeBuildRefs knows about one Message-ID
+// (as for IDEntry, the containers are an array indexed by MsgID)
+// - every ID seen in a Message-ID, References or In-Reply-To field
+//   has a container; the first message with that ID fills it in, and
+//   the others (duplicates) are threaded as messages with no ID
+// - parent links between containers are worked out first, for the
+//   whole mailbox, then the tree is made from them (see below)
+typedef struct Container {
+	MailMessage mesg;	// first message with this ID (NULL = missing)
+	MsgID parent;		// ID this one is a reply to (or NO_MSGID)
+	uint32_t nreplies;	// number of IDs with this one as parent
+	MsgID up;		// (missing only) nearest ancestor in the tree
+	Link node;		// its node in the tree, once made
+} Container;
+
+typedef struct Containers {
+	Container *all;		// one container for each MsgID
+	size_t size;		// size of all array
+	IDTable ids;		// where IDs are interned
+} Containers;
+
 typedef struct ThreadTreeRep {
 	Link messages;
+	Link last; // last node in top-level messages list
+	size_t nadded; // number of messages added so far
+	IDEntry *ids;	// entry for each MsgID (see above)
+	size_t nids;	// size of ids array
+	IDTable names;	// IDs of missing messages (ThreadTreeBuildRefs)
+	Arena arena; // where nodes come from (NULL = malloc)
 } ThreadTreeRep;
 
+#define MIN_IDS 64
+
 // Auxiliary data structures and functions
 // Add any new data structures and functions here ...
 
-//Queue prototypes
-static Queue newQueue (void);
-static void dropQueue (Queue);
-static void QueueJoin (Queue, Link);
-static Link QueueLeave (Queue);
-static bool QueueIsEmpty (Queue);
+//IDEntry prototypes
+static IDEntry *IDEntryFor (ThreadTree tt, MsgID key);
+static IDEntry *newIDEntries (Arena arena, size_t n);
 
 //ThreadTree prototypes
 static void doDropThreadTree (Link t);
-static void doShowThreadTree (Link t, int level);
-static Link newTTNode(MailMessage message);
-static void insertThreadTree(Link root, Link newNode);
-static void insertAfterReplies(Link start, Link newNode);
-static void insertAfterNext(Link start, Link newNode);
-static bool isReplyIDNull(Link link);
-static bool isMessageIDNull(Link link);
-static bool isMessageAndReplyIDEqual(Link n1, Link n2);
+static void doShowThreadTree (OutBuf out, IDTable names, Link t, int level);
+static void showMissing (OutBuf out, char *id, int level);
+static Link newTTNode(Arena arena, MailMessage message, size_t seq);
+static bool threadsBefore (Link a, Link b);
+static size_t insertInOrder(Link *first, Link *last, Link parent, Link newNode);
+static void unlinkNode(Link *first, Link *last, Link node);
+static size_t addNode (ThreadTree tt, MailMessage mesg, size_t seq);
+static bool hangsUnder (Link node, Link top);
+
+//Container prototypes
+static Container *ContainerFor (Containers *cs, MsgID id);
+static MsgID lastReference (Containers *cs, MailMessage mesg);
+static void linkReferences (Containers *cs, MailMessage mesg);
+static void setParent (Containers *cs, MsgID child, MsgID parent);
+static bool isAncestor (Containers *cs, MsgID a, MsgID b);
+static MsgID placeInTree (Containers *cs, MsgID parent);
 
 
 // END auxiliary data structures and functions
@@ -68,27 +115,40 @@ static bool isMessageAndReplyIDEqual(Link n1, Link n2);
 // create a new empty ThreadTree
 ThreadTree newThreadTree (void)
 {
-	ThreadTreeRep *new = malloc (sizeof *new);
-	if (new == NULL) err (EX_OSERR, "couldn't allocate ThreadTree");
-	*new = (ThreadTreeRep) { };
+	return newThreadTreeIn (NULL);
+}
+
+// create a new empty ThreadTree whose nodes come from an Arena
+// (a NULL Arena means use malloc)
+ThreadTree newThreadTreeIn (Arena arena)
+{
+	ThreadTreeRep *new = ArenaAlloc (arena, sizeof *new);
+	*new = (ThreadTreeRep) { .nids = MIN_IDS, .arena = arena };
+	new->ids = newIDEntries (arena, new->nids);
 	return new;
 }
 
 void dropThreadTree (ThreadTree tt)
 {
 	assert (tt != NULL);
+	if (tt->arena != NULL)
+		return; // nodes are released with the Arena
 	doDropThreadTree (tt->messages);
+	free (tt->ids);
+	free (tt);
 }
 
 // free up memory associated with list
+// (each node's replies are spliced into the list just after it, so
+// the whole tree is freed in one pass with no recursion or stack)
 static void doDropThreadTree (Link t)
 {
-	if (t == NULL)
-		return;
-
 	for (Link curr = t, next; curr != NULL; curr = next) {
+		if (curr->replies != NULL) {
+			curr->lastReply->next = curr->next;
+			curr->next = curr->replies;
+		}
 		next = curr->next;
-		doDropThreadTree (curr->replies);
 		// don't drop curr->mesg, in case referenced elsehwere
 		free (curr);
 	}
@@ -97,232 +157,512 @@ static void doDropThreadTree (Link t)
 void showThreadTree (ThreadTree tt)
 {
 	assert (tt != NULL);
-	doShowThreadTree (tt->messages, 0);
+	OutBuf out = newOutBuf (stdout);
+	doShowThreadTree (out, tt->names, tt->messages, 0);
+	dropOutBuf (out);
 }
 
 // display thread tree as hiearchical list
-static void doShowThreadTree (Link t, int level)
+// (pre-order walk using the parent links to climb back up, so long
+// reply chains need no recursion or stack)
+static void doShowThreadTree (OutBuf out, IDTable names, Link t, int level)
 {
-	if (t == NULL)
-		return;
-	for (Link curr = t; curr != NULL; curr = curr->next) {
-		showMailMessage (curr->mesg, level);
-		doShowThreadTree (curr->replies, level + 1);
+	Link curr = t;
+	while (curr != NULL) {
+		if (curr->mesg != NULL)
+			showMailMessageOn (out, curr->mesg, level);
+		else
+			showMissing (out, IDTableName (names, curr->missing), level);
+		if (curr->replies != NULL) {
+			curr = curr->replies;
+			level++;
+			continue;
+		}
+		// no replies: move on to next sibling, or an ancestor's
+		while (curr != NULL && curr->next == NULL) {
+			curr = curr->parent;
+			level--;
+		}
+		if (curr != NULL)
+			curr = curr->next;
 	}
 }
 
+// display a missing message, in the same frame as a MailMessage
+static void showMissing (OutBuf out, char *id, int level)
+{
+	int in = 3 * level;
+	OutBufIndent (out, in);
+	OutBufPuts (out, "/----------\n");
+	OutBufIndent (out, in);
+	OutBufPuts (out, "| M-ID: ");
+	OutBufPuts (out, id);
+	OutBufPuts (out, "\n");
+	OutBufIndent (out, in);
+	OutBufPuts (out, "| (not in mailbox)\n");
+	OutBufIndent (out, in);
+	OutBufPuts (out, "\\----------\n");
+}
+
 //create a new Thread Tree Node
-static Link newTTNode(MailMessage message){
-	Link new = malloc (sizeof (ThreadTreeNode));
-	assert (new != NULL);
-	new->mesg = message;
-	new->next = new->replies = NULL;
+static Link newTTNode(Arena arena, MailMessage message, size_t seq){
+	Link new = ArenaAlloc (arena, sizeof (ThreadTreeNode));
+	*new = (ThreadTreeNode) {
+		.mesg = message, .key = MailMessageTimestamp (message),
+		.seq = (uint32_t) seq
+	};
 	return new;
 }
 
-
-/*
-Function to add a Link to the end of a list
-Link start: root of the list
-Link newNode: node to be inserted in list
-*/
-static void insertAfterNext(Link start, Link newNode){
-	
-	while(start->next != NULL){
-		start = start->next;
-	}
-	start->next = newNode;
+// does node a come before node b in thread order?
+// (timestamp order, with MMList's tie rule: a message goes before
+// any that were added before it with the same timestamp)
+static bool threadsBefore (Link a, Link b){
+	if (a->key != b->key)
+		return TimestampBefore (a->key, b->key);
+	return a->seq > b->seq;
 }
 
 
 /*
-Function to add a Link to the end of it's Replies list
-Link start: root of the list
+Function to add a Link to a list, keeping the list in thread order
+Link *first: head of the list
+Link *last: tail of the list (NULL if list is empty)
+Link parent: node the list hangs from (NULL for top-level list)
 Link newNode: node to be inserted in list
+Messages mostly arrive in order, so the search starts from the tail
+and is usually constant time.
+Returns the number of nodes looked at.
 */
-static void insertAfterReplies(Link start, Link newNode){
-	if(start->replies == NULL){
-		start->replies = newNode;
-	}else{
-		insertAfterNext(start->replies, newNode);
+static size_t insertInOrder(Link *first, Link *last, Link parent, Link newNode){
+	size_t visits = 0;
+	Link pos = *last;
+	while (pos != NULL && threadsBefore (newNode, pos)) {
+		pos = pos->prev;
+		visits++;
 	}
-}
 
-//Function to check if a given Link has a replyID == NULL
-static bool isReplyIDNull(Link link){
-	if ( MailMessageRepliesTo(link->mesg) == NULL){
-		return true;
-	}else{
-		return false;
-	}
+	newNode->parent = parent;
+	newNode->prev = pos;
+	newNode->next = (pos == NULL) ? *first : pos->next;
+	if (pos == NULL)
+		*first = newNode;
+	else
+		pos->next = newNode;
+	if (newNode->next == NULL)
+		*last = newNode;
+	else
+		newNode->next->prev = newNode;
+	return visits + 1;
 }
 
-//Function to check if a given Link has a messageID == NULL
-static bool isMessageIDNull(Link link){
-	if ( MailMessageID(link->mesg) == NULL){
-		return true;
-	}else{
-		return false;
-	}
+/*
+Function to take a Link out of a list, in constant time
+Link *first: head of the list
+Link *last: tail of the list
+Link node: node to be removed (with its replies)
+*/
+static void unlinkNode(Link *first, Link *last, Link node){
+	if (node->prev == NULL)
+		*first = node->next;
+	else
+		node->prev->next = node->next;
+	if (node->next == NULL)
+		*last = node->prev;
+	else
+		node->next->prev = node->prev;
+	node->next = node->prev = NULL;
 }
 
-//Function to check if two given Links have the same reply ID
-static bool isReplyIDEqual(Link n1, Link n2){
-	//NOTE: strcmp does not take null as a valid argument
-	if ( !isReplyIDNull(n1) && !isReplyIDNull(n2) &&
-			strcmp( MailMessageRepliesTo(n1->mesg), MailMessageRepliesTo(n2->mesg)) == 0 ){
-		return true;
-	}else{
-		return false;
-	}
+// add one mail message to a ThreadTree, as it arrives
+// - a reply goes into its parent's replies list, if the parent has
+//   already been added and its timestamp is not later than the reply's
+// - otherwise it starts a new top-level thread; if its parent has not
+//   been seen yet, it is moved under the parent when that arrives
+// - of several messages with the same ID, replies go to the first
+// - each list is in timestamp order; as in MMList, a message goes
+//   before any added earlier with the same timestamp
+// messages are found by the handles of their interned IDs, so no
+// strings are hashed or compared: O(1) time per message when they
+// arrive roughly in order
+ThreadTree ThreadTreeAdd (ThreadTree tt, MailMessage mesg)
+{
+	assert (tt != NULL && mesg != NULL);
+	size_t visits = addNode (tt, mesg, tt->nadded++);
+	StatsCount (ST_THREAD_ADDS, 1);
+	StatsCount (ST_THREAD_VISITS, visits);
+	return tt;
 }
 
-//Function to compare the messageID of Link n1 with replyID of Link n2
-static bool isMessageAndReplyIDEqual(Link n1, Link n2){
-	//NOTE: strcmp does not take null as a valid argument
-	if ( !isMessageIDNull(n1) && !isReplyIDNull(n2) &&
-			strcmp( MailMessageID(n1->mesg), MailMessageRepliesTo(n2->mesg)) == 0 ){
-		return true;
-	}else{
-		return false;
+// put a message into the tree as the seq'th to arrive, as for
+// ThreadTreeAdd; return the number of nodes looked at
+// (this function is used only within the ADT)
+static size_t addNode (ThreadTree tt, MailMessage mesg, size_t seq)
+{
+	MsgID key = MailMessageIDKey (mesg);
+	MsgID replyKey = MailMessageRepliesToKey (mesg);
+	assert (key != NO_MSGID || MailMessageID (mesg) == NULL);
+	assert (replyKey != NO_MSGID || MailMessageRepliesTo (mesg) == NULL);
+	Link newNode = newTTNode (tt->arena, mesg, seq);
+
+	//find node of message being replied to (if any)
+	size_t visits = 0;
+	IDEntry *parent = IDEntryFor (tt, replyKey);
+	if (parent != NULL && parent->node != NULL) {
+		if (! TimestampAfter (parent->node->key, newNode->key))
+			visits += insertInOrder (&parent->node->replies,
+				&parent->node->lastReply, parent->node, newNode);
+		else
+			visits += insertInOrder (&tt->messages, &tt->last, NULL,
+				newNode);
+	} else {
+		visits += insertInOrder (&tt->messages, &tt->last, NULL, newNode);
+		if (parent != NULL) {
+			newNode->waiting = parent->waiting;
+			parent->waiting = newNode;
+		}
 	}
-}
-
-/*
-Function to insert a given Link to a ThreadTree
-Link root: the root of the ThreadTree
-Link newNode: the node to be inserted into ThreadTree
-*/
-static void insertThreadTree(Link root, Link newNode){
-	Queue q = newQueue();
-
-	QueueJoin(q, root);
 
-	while( !QueueIsEmpty(q) ){
-
-		Link node = QueueLeave(q);
-		
-		//Processing node 
-		if ( (isReplyIDNull(node) && isReplyIDNull(newNode)) || isReplyIDEqual(node, newNode) ) {
-			//Replies ID's of node and newNode match
-			insertAfterNext(node, newNode);
-			break;
-		}else if( (isMessageIDNull(node) && isMessageIDNull(newNode)) || isMessageAndReplyIDEqual(node, newNode) ){
-			//MailID of node and replyID of newNode match
-			insertAfterReplies(node, newNode);
-			break;
-		}
-		
-		if(node->replies != NULL){
-			QueueJoin(q, node->replies);
-		}
-		if(node->next != NULL){
-			QueueJoin(q, node->next);
+	// record ID, and adopt any earlier replies that were waiting for it
+	IDEntry *self = IDEntryFor (tt, key);
+	if (self != NULL && self->node == NULL) {
+		self->node = newNode;
+		for (Link w = self->waiting, next; w != NULL; w = next) {
+			next = w->waiting;
+			w->waiting = NULL;
+			visits++;
+			if (TimestampAfter (newNode->key, w->key))
+				continue; // stays a top-level thread
+			// (with equal timestamps, w may be this very message, or
+			// the thread it hangs under: adopting it would make a loop)
+			if (newNode->key == w->key && hangsUnder (newNode, w))
+				continue;
+			unlinkNode (&tt->messages, &tt->last, w);
+			visits += insertInOrder (&newNode->replies,
+				&newNode->lastReply, newNode, w);
 		}
+		self->waiting = NULL;
 	}
-	dropQueue(q);
+	return visits;
+}
+
+// is node the same as top, or in the replies under it?
+// (walks up from node, so takes time in proportion to its depth)
+// (this function is used only within the ADT)
+static bool hangsUnder (Link node, Link top)
+{
+	for (Link n = node; n != NULL; n = n->parent)
+		if (n == top)
+			return true;
+	return false;
 }
 
 // insert mail message into ThreadTree
 // if a reply, insert in appropriate replies list
 // whichever list inserted, must be in timestamp-order
+// - messages are added one at a time as by ThreadTreeAdd, in MMList
+//   order, which gives the same tree as threading them as they arrive
+//   (MMList puts the newest of messages with the same timestamp
+//   first, so they are numbered counting down, as if they arrived
+//   in the opposite order, and keep their MMList order in the tree)
+// - messages whose parent is not in the mailbox, or is later than
+//   the reply, start a new top-level thread
+// - msgids is not needed (messages are found by their interned IDs),
+//   and may be NULL
 ThreadTree ThreadTreeBuild (MMList mesgs, MMTree msgids)
 {
+	return ThreadTreeBuildIn (mesgs, msgids, NULL);
+}
+
+// as for ThreadTreeBuild, but allocate the tree from an Arena
+ThreadTree ThreadTreeBuildIn (MMList mesgs, MMTree msgids, Arena arena)
+{
+	(void) msgids;
+
 	//Create thread tree
-	ThreadTreeRep* tt = newThreadTree();
-	tt->messages = NULL;
+	ThreadTreeRep* tt = newThreadTreeIn(arena);
 
+	//Iterating through the MMList, in timestamp order
+	MailMessage lNode;
+	size_t n = 0, visits = 0;
+	MMListStart(mesgs);
+	while((lNode = MMListNext (mesgs)) != NULL)
+		n++;
 	MMListStart(mesgs);
-	MailMessage lNode = MMListNext(mesgs);
+	for (size_t i = n; (lNode = MMListNext (mesgs)) != NULL; i--)
+		visits += addNode (tt, lNode, tt->nadded + i - 1);
+	tt->nadded += n;
+
+	StatsCount (ST_THREAD_ADDS, n);
+	StatsCount (ST_THREAD_VISITS, visits);
+	return tt; 
+}
 
-	//Create Thread Tree Node to be inserted
-	Link newNode = newTTNode(lNode);
 
-	if(tt->messages == NULL){
-		//Thread tree is empty
-		tt->messages = newNode;
+// thread messages by their References and In-Reply-To fields, using
+// Jamie Zawinski's container algorithm ("message threading")
+// 1. each message's references (oldest first) are taken to be a
+//    chain of ancestors: each ID is made the parent of the next one,
+//    unless that one already has a parent, or it would make a loop;
+//    then the message's own ID is made a reply to the last of them
+//    (or to its In-Reply-To, if it has no references), replacing
+//    any parent guessed from other messages' references
+// 2. each message is put in the replies list of its nearest ancestor
+//    that is in the mailbox; missing ancestors are left out, except
+//    that two or more top-level threads replying to the same missing
+//    message are grouped under a node standing for it
+// - unlike ThreadTreeBuild, a reply goes under its parent even if
+//   the parent's timestamp is later
+// - messages are found by the handles of their interned IDs, so each
+//   message takes time in proportion to its number of references (a
+//   loop check only walks up the tree when a message that already
+//   has replies is given a new parent)
+// - the IDs in References fields are interned in ids, which must be
+//   the IDTable that the messages were interned in
+ThreadTree ThreadTreeBuildRefs (MMList mesgs, IDTable ids)
+{
+	return ThreadTreeBuildRefsIn (mesgs, ids, NULL);
+}
+
+// as for ThreadTreeBuildRefs, but allocate the tree from an Arena
+ThreadTree ThreadTreeBuildRefsIn (MMList mesgs, IDTable ids, Arena arena)
+{
+	assert (mesgs != NULL && ids != NULL);
+	ThreadTreeRep *tt = newThreadTreeIn (arena);
+	tt->names = ids;
+	Containers cs = { .ids = ids };
+
+	// 1. work out the parent of each ID
+	MailMessage mesg;
+	size_t n = 0;
+	MMListStart (mesgs);
+	while ((mesg = MMListNext (mesgs)) != NULL) {
+		n++;
+		MsgID key = MailMessageIDKey (mesg);
+		assert (key != NO_MSGID || MailMessageID (mesg) == NULL);
+		linkReferences (&cs, mesg);
+		MsgID parent = lastReference (&cs, mesg);
+		Container *c = ContainerFor (&cs, key);
+		if (c != NULL && c->mesg == NULL) {
+			c->mesg = mesg;
+			setParent (&cs, key, parent);
+		}
 	}
 
-	//Setting curr as the root of ThreadTree
-	Link curr = NULL;
-	if(tt->messages != NULL){
-		curr = tt->messages;
+	// 2. make a node for each message, chained through next in thread
+	// (MMList) order, and numbered counting down as for ThreadTreeBuild
+	// ...
+	Link first = NULL, last = NULL;
+	MMListStart (mesgs);
+	for (size_t i = n; (mesg = MMListNext (mesgs)) != NULL; i--) {
+		Link node = newTTNode (tt->arena, mesg, tt->nadded + i - 1);
+		Container *c = ContainerFor (&cs, MailMessageIDKey (mesg));
+		if (c != NULL && c->mesg == mesg)
+			c->node = node;
+		if (last == NULL)
+			first = node;
+		else
+			last->next = node;
+		last = node;
 	}
-	 
-	//Iterating through the MMList
-	while((lNode = MMListNext (mesgs)) != NULL){
-		
-		//create a new threadtree node to be inserted
-		newNode = newTTNode(lNode);
-
-		//Reset curr after each iteration
-		curr = tt->messages;
-		insertThreadTree(curr, newNode);
+	tt->nadded += n;
+
+	// ... then put them in the tree, in that order, so each one goes
+	// at the end of its list (parents always have their nodes by now)
+	size_t visits = 0;
+	for (Link node = first, next; node != NULL; node = next) {
+		next = node->next;
+		node->next = NULL;
+		Container *c = ContainerFor (&cs, MailMessageIDKey (node->mesg));
+		MsgID parent = (c != NULL && c->node == node) ?
+			c->parent : lastReference (&cs, node->mesg);
+		MsgID place = placeInTree (&cs, parent);
+		if (place == NO_MSGID) {
+			visits += insertInOrder (&tt->messages, &tt->last, NULL, node);
+			continue;
+		}
+		Container *p = &cs.all[place];
+		if (p->node == NULL) {
+			// first thread to reply to a top-most missing message
+			p->node = ArenaAlloc (tt->arena, sizeof (ThreadTreeNode));
+			*p->node = (ThreadTreeNode) {
+				.key = node->key, .seq = node->seq, .missing = place
+			};
+			visits += insertInOrder (&tt->messages, &tt->last, NULL,
+				p->node);
+		}
+		visits += insertInOrder (&p->node->replies, &p->node->lastReply,
+			p->node, node);
 	}
-	return tt; 
-}
 
+	// a missing message with only one reply isn't worth showing: the
+	// reply takes its place (it has the same key, so order is kept)
+	for (Link r = tt->messages; r != NULL; r = r->next) {
+		if (r->mesg != NULL || r->replies != r->lastReply)
+			continue;
+		Link only = r->replies;
+		only->parent = NULL;
+		only->prev = r->prev;
+		only->next = r->next;
+		if (r->prev == NULL)
+			tt->messages = only;
+		else
+			r->prev->next = only;
+		if (r->next == NULL)
+			tt->last = only;
+		else
+			r->next->prev = only;
+		if (tt->arena == NULL)
+			free (r);
+		r = only;
+	}
 
+	free (cs.all);
+	StatsCount (ST_THREAD_ADDS, tt->nadded);
+	StatsCount (ST_THREAD_VISITS, visits);
+	return tt;
+}
 
-// Implementations of Queue Functions
+// Implementations of Container Functions
 
-// create new empty Queue
-static Queue newQueue (void)
+// find the container for an ID (NULL for NO_MSGID)
+// the array grows (doubling) to cover the largest handle seen, so
+// pointers into it are only good until the next call
+static Container *ContainerFor (Containers *cs, MsgID id)
 {
-	Queue new = malloc (sizeof *new);
-	if (new == NULL) err (EX_OSERR, "couldn't allocate Queue");
-	*new = (QueueRep) { .head = NULL, .tail = NULL };
-	return new;
+	if (id == NO_MSGID)
+		return NULL;
+	if (id >= cs->size) {
+		size_t nold = cs->size;
+		if (cs->size == 0)
+			cs->size = MIN_IDS;
+		while (id >= cs->size)
+			cs->size *= 2;
+		cs->all = realloc (cs->all, cs->size * sizeof *cs->all);
+		if (cs->all == NULL) err (EX_OSERR, "couldn't allocate Containers");
+		for (size_t i = nold; i < cs->size; i++)
+			cs->all[i] = (Container) { };
+	}
+	return &cs->all[id];
 }
 
-// free memory used by Queue
-static void dropQueue (Queue Q)
+// ID a message replies to: the last of its references, or if it has
+// none, its In-Reply-To (NO_MSGID if neither)
+static MsgID lastReference (Containers *cs, MailMessage mesg)
 {
-	assert (Q != NULL);
+	size_t n;
+	char *ref = MailMessageReferences (mesg, &n);
+	if (n == 0)
+		return MailMessageRepliesToKey (mesg);
+	for (size_t i = 1; i < n; i++)
+		ref += strlen (ref) + 1;
+	MsgID id = IDTableIntern (cs->ids, ref);
+	ContainerFor (cs, id);
+	return id;
+}
 
-	// free list nodes
-	QueueNode *curr = Q->head;
-	while (curr != NULL) {
-		QueueNode *next = curr->next;
-		free (curr);
-		curr = next;
+// link up the chain of IDs in a message's references: each one that
+// has no parent yet is taken to be a reply to the one before it
+static void linkReferences (Containers *cs, MailMessage mesg)
+{
+	size_t n;
+	char *ref = MailMessageReferences (mesg, &n);
+	MsgID prev = NO_MSGID;
+	for (size_t i = 0; i < n; i++, ref += strlen (ref) + 1) {
+		MsgID id = IDTableIntern (cs->ids, ref);
+		ContainerFor (cs, id);
+		if (prev != NO_MSGID && cs->all[id].parent == NO_MSGID)
+			setParent (cs, id, prev);
+		prev = id;
 	}
-	// free queue rep
-	free (Q);
 }
 
-// add item at end of Queue
-static void QueueJoin (Queue Q, Link it)
+// make parent (which may be NO_MSGID) the parent of child, instead of
+// any parent it had, unless that would make a loop
+static void setParent (Containers *cs, MsgID child, MsgID parent)
 {
-	assert (Q != NULL);
+	Container *c = &cs->all[child];
+	if (c->parent == parent)
+		return;
+	if (parent != NO_MSGID && isAncestor (cs, child, parent))
+		return;
+	if (c->parent != NO_MSGID)
+		cs->all[c->parent].nreplies--;
+	c->parent = parent;
+	if (parent != NO_MSGID)
+		cs->all[parent].nreplies++;
+}
 
-	QueueNode *new = malloc (sizeof *new);
-	if (new == NULL) err (EX_OSERR, "couldn't allocate Queue node");
-	*new = (QueueNode) { .value = it, .next = NULL };
+// is ID a the same as b, or one of its ancestors?
+// (only an ID with replies can be an ancestor, so usually no walk)
+static bool isAncestor (Containers *cs, MsgID a, MsgID b)
+{
+	if (a == b)
+		return true;
+	if (cs->all[a].nreplies == 0)
+		return false;
+	for (MsgID p = cs->all[b].parent; p != NO_MSGID; p = cs->all[p].parent)
+		if (p == a)
+			return true;
+	return false;
+}
 
-	if (Q->head == NULL)
-		Q->head = new;
-	if (Q->tail != NULL)
-		Q->tail->next = new;
-	Q->tail = new;
+// where does a message with the given parent go in the tree?
+// the nearest ancestor (starting with parent) that is in the mailbox,
+// or if none is, the top-most missing one (NO_MSGID if no parent)
+// the answer is remembered for each missing ID walked over, so each
+// is only walked over once
+static MsgID placeInTree (Containers *cs, MsgID parent)
+{
+	MsgID place = parent;
+	while (place != NO_MSGID) {
+		Container *c = &cs->all[place];
+		if (c->mesg != NULL)
+			break;
+		if (c->up != NO_MSGID) {
+			place = c->up;
+			break;
+		}
+		if (c->parent == NO_MSGID)
+			break;
+		place = c->parent;
+	}
+	for (MsgID id = parent; id != NO_MSGID && id != place; ) {
+		Container *c = &cs->all[id];
+		if (c->mesg != NULL || c->up != NO_MSGID)
+			break;
+		c->up = place;
+		id = c->parent;
+	}
+	return place;
 }
 
-// remove item from front of Queue
-static Link QueueLeave (Queue Q)
+// Implementations of IDEntry Functions
+
+// find the entry for an ID's handle (NULL for NO_MSGID)
+// the array grows (doubling) to cover the largest handle seen
+static IDEntry *IDEntryFor (ThreadTree tt, MsgID key)
 {
-	assert (Q != NULL);
-	assert (Q->head != NULL);
-	Link it = Q->head->value;
-	QueueNode *old = Q->head;
-	Q->head = old->next;
-	if (Q->head == NULL)
-		Q->tail = NULL;
-	free (old);
-	return it;
+	if (key == NO_MSGID)
+		return NULL;
+	if (key >= tt->nids) {
+		size_t nold = tt->nids;
+		while (key >= tt->nids)
+			tt->nids *= 2;
+		IDEntry *old = tt->ids;
+		tt->ids = newIDEntries (tt->arena, tt->nids);
+		memcpy (tt->ids, old, nold * sizeof *old);
+		if (tt->arena == NULL)
+			free (old);
+	}
+	return &tt->ids[key];
 }
 
-// check for no items
-static bool QueueIsEmpty (Queue Q)
+// make an array of n empty entries
+static IDEntry *newIDEntries (Arena arena, size_t n)
 {
-	return Q->head == NULL;
+	IDEntry *ids = ArenaAlloc (arena, n * sizeof *ids);
+	for (size_t i = 0; i < n; i++)
+		ids[i] = (IDEntry) { };
+	return ids;
 }
@@ -4,6 +4,8 @@
 #ifndef THREAD_TREE_H
 #define THREAD_TREE_H
 
+#include "Arena.h"
+#include "IDTable.h"
 #include "MMList.h"
 #include "MMTree.h"
 #include "MailMessage.h"
@@ -15,15 +17,46 @@ typedef struct ThreadTreeRep *ThreadTree;
 // create a new empty ThreadTree
 ThreadTree newThreadTree (void);
 
+// create a new empty ThreadTree, allocated from an Arena
+// (dropArena releases it; dropThreadTree need not be called)
+ThreadTree newThreadTreeIn (Arena);
+
 // free up memory associated with list
 void dropThreadTree (ThreadTree);
 
 // display list as one integer per line on stdout
 void showThreadTree (ThreadTree);
 
+// add one mail message to the tree, as soon as it has been read
+// messages may arrive in any order: a reply that arrives before the
+// message it replies to is moved under it when that message is added
+// (the tree can be shown, or added to, at any time)
+// all messages in a tree must have been interned in the same IDTable
+// (see MailMessageIntern), as they are if read from one MailBox
+ThreadTree ThreadTreeAdd (ThreadTree, MailMessage);
+
 // insert mail message in order
 // if message is a reply, 3rd arg says what it's a reply to
 // ordering based on MailMessageDate
+// (the MMTree is no longer needed, and may be NULL)
 ThreadTree ThreadTreeBuild (MMList, MMTree);
 
+// as for ThreadTreeBuild, but allocate the tree from an Arena
+// (dropArena releases it; dropThreadTree need not be called)
+ThreadTree ThreadTreeBuildIn (MMList, MMTree, Arena);
+
+// thread messages by their References fields (and In-Reply-To, for
+// messages without References), so that a reply still goes into its
+// thread when the message it answers isn't in the mailbox
+// (see ThreadTree.c for the rules; top-level threads replying to the
+// same missing message are grouped under a node that shows its ID)
+// the IDTable is the one the messages were interned in (e.g. see
+// MailBoxIDs); IDs from References fields are added to it
+// (the tree can be shown, but should not then be added to)
+ThreadTree ThreadTreeBuildRefs (MMList, IDTable);
+
+// as for ThreadTreeBuildRefs, but allocate the tree from an Arena
+// (dropArena releases it; dropThreadTree need not be called)
+ThreadTree ThreadTreeBuildRefsIn (MMList, IDTable, Arena);
+
 #endif
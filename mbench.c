@@ -0,0 +1,162 @@
+// mbench.c ... time each phase of task1/task2/task3 on one mailbox
+// Runs the same steps as the task drivers (parse, build MMList,
+// build MMTree, build ThreadTree both ways, render each of them),
+// timing each phase separately, and reports time, throughput and
+// peak RSS.
+// Rendered output is discarded; the report goes to stdout.
+// For meaningful numbers, build without the sanitizers, e.g.
+//     make clean && make CC=cc CFLAGS=-O2 bench
+
+#include <err.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sysexits.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Arena.h"
+#include "MailBox.h"
+#include "MMList.h"
+#include "MMTree.h"
+#include "MailMessage.h"
+#include "ThreadTree.h"
+
+static double now (void);
+static void report (const char *phase, double secs, size_t nmsgs,
+	double mbytes);
+static int discardOutput (void);
+static void restoreOutput (int saved);
+
+int main (int argc, char *argv[])
+{
+	// Process command line args
+	// -i keeps an index of the mailbox in <mailbox>.idx
+	// -j N parses the mailbox on N threads (0 = one per CPU)
+	bool useIndex = false;              // use sidecar index?
+	int nthreads = 1;                   // parser threads
+	int opt;
+	while ((opt = getopt (argc, argv, "ij:")) != -1) {
+		if (opt == 'i')
+			useIndex = true;
+		else if (opt == 'j')
+			nthreads = atoi (optarg);
+		else
+			argc = 0; // force usage message
+	}
+	if (argc - optind != 1)
+		errx (EX_USAGE, "usage: %s [-i] [-j threads] <mailbox>", argv[0]);
+	char *mailbox = argv[optind];
+
+	struct stat info;
+	if (stat (mailbox, &info) < 0)
+		err (EX_DATAERR, "can't open %s", mailbox);
+	double mbytes = (double) info.st_size / (1024.0 * 1024.0);
+
+	// parse: open, map and read every message
+	double start = now ();
+	MailBox in;
+	if ((in = newMailBox (mailbox)) == NULL)
+		err (EX_DATAERR, "can't open %s", mailbox);
+	if (useIndex)
+		MailBoxUseIndex (in, NULL);
+	size_t nmsgs;
+	MailMessage *msgs = MailBoxReadAll (in, nthreads, &nmsgs);
+	double parsed = now ();
+	Arena mem = MailBoxArena (in);
+
+	printf ("%s: %zu messages, %.1f MB, %d parse thread(s)\n",
+		mailbox, nmsgs, mbytes, nthreads);
+	printf ("%-12s %10s %14s %10s\n", "phase", "seconds", "messages/s",
+		"MB/s");
+	report ("parse", parsed - start, nmsgs, mbytes);
+
+	start = now ();
+	MMList msgList = newMMListIn (mem);
+	for (size_t i = 0; i < nmsgs; i++)
+		MMListAppendUnordered (msgList, msgs[i]);
+	MMListFinalize (msgList);
+	report ("MMList", now () - start, nmsgs, 0);
+
+	start = now ();
+	MMTree msgIDs = newMMTreeIn (mem);
+	for (size_t i = 0; i < nmsgs; i++)
+		MMTreeInsert (msgIDs, MailMessageID (msgs[i]), msgs[i]);
+	report ("MMTree", now () - start, nmsgs, 0);
+
+	start = now ();
+	ThreadTree threads = ThreadTreeBuildIn (msgList, NULL, mem);
+	report ("ThreadTree", now () - start, nmsgs, 0);
+
+	start = now ();
+	ThreadTreeBuildRefsIn (msgList, MailBoxIDs (in), mem);
+	report ("ThreadRefs", now () - start, nmsgs, 0);
+
+	// render each structure, as task1, task2 and task3 do
+	int saved = discardOutput ();
+	start = now ();
+	showMMList (msgList);
+	double listShown = now ();
+	showMMTree (msgIDs);
+	double treeShown = now ();
+	showThreadTree (threads);
+	double threadsShown = now ();
+	restoreOutput (saved);
+	report ("show MMList", listShown - start, nmsgs, 0);
+	report ("show MMTree", treeShown - listShown, nmsgs, 0);
+	report ("show Thread", threadsShown - treeShown, nmsgs, 0);
+
+	printf ("MMTree depth: %d\n", MMTreeDepth (msgIDs));
+	struct rusage usage;
+	getrusage (RUSAGE_SELF, &usage);
+	printf ("peak RSS: %ld KB\n", usage.ru_maxrss);
+
+	free (msgs);
+	dropMailBox (in);
+	return EXIT_SUCCESS;
+}
+
+// current time (seconds), for timing phases
+static double now (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+// print one line of the report
+// (MB/s is only shown for phases that read the mailbox)
+static void report (const char *phase, double secs, size_t nmsgs,
+	double mbytes)
+{
+	double rate = (secs > 0) ? (double) nmsgs / secs : 0;
+	if (mbytes > 0)
+		printf ("%-12s %10.4f %14.0f %10.1f\n", phase, secs, rate,
+			(secs > 0) ? mbytes / secs : 0);
+	else
+		printf ("%-12s %10.4f %14.0f %10s\n", phase, secs, rate, "-");
+}
+
+// send stdout to /dev/null (returns where it used to go)
+static int discardOutput (void)
+{
+	fflush (stdout);
+	int saved = dup (STDOUT_FILENO);
+	int null = open ("/dev/null", O_WRONLY);
+	if (saved < 0 || null < 0)
+		err (EX_OSERR, "couldn't redirect output");
+	dup2 (null, STDOUT_FILENO);
+	close (null);
+	return saved;
+}
+
+// send stdout back to where it went before discardOutput
+static void restoreOutput (int saved)
+{
+	fflush (stdout);
+	dup2 (saved, STDOUT_FILENO);
+	close (saved);
+}
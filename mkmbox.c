@@ -0,0 +1,183 @@
+// mkmbox.c ... generate a synthetic mailbox for benchmarking
+// The output depends only on the options (and seed), so the same
+// mailbox can be regenerated anywhere.
+//
+// Messages come in threads; each thread is a tree in which every
+// message has up to F replies, down to D levels of replies (F = 1
+// gives a single reply chain D messages long).  W threads are open
+// at once, and each message comes from a randomly chosen open one.
+// Messages are (nominally) a minute apart, but each Date: is moved
+// by a random amount of up to +/- T seconds, so a large T gives a
+// mailbox that is well out of timestamp order.
+
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <time.h>
+#include <unistd.h>
+
+// first message is dated 1 Feb 2019, 00:00:00 UTC
+#define BASE_TIME 1548979200
+
+// a thread that is being written out
+typedef struct Thread {
+	unsigned long id;	// thread number (for subjects)
+	unsigned long *mesgs;	// message number of each message so far
+	size_t next, size;	// number written so far, size of thread
+	size_t max;		// size of mesgs array
+} Thread;
+
+// Message-ID patterns
+typedef enum { SEQ, RANDOM, PREFIX } IDPattern;
+
+static uint64_t rng;	// state of random number generator
+
+static uint64_t nextRandom (void);
+static void showID (IDPattern pattern, unsigned long n);
+static void startThread (Thread *t, unsigned long id, size_t size);
+
+int main (int argc, char *argv[])
+{
+	// Process command line args
+	unsigned long nmesgs = 1000;	// -n: number of messages
+	size_t fanout = 3;		// -f: replies per message
+	size_t depth = 4;		// -d: levels of replies
+	size_t width = 8;		// -w: threads open at once
+	long disorder = 0;		// -t: max timestamp shift (secs)
+	size_t nlines = 5;		// -b: lines in each body
+	IDPattern pattern = RANDOM;	// -m: form of Message-IDs
+	rng = 2521;			// -s: random seed
+	int opt;
+	while ((opt = getopt (argc, argv, "n:f:d:w:t:b:m:s:")) != -1) {
+		switch (opt) {
+		case 'n': nmesgs = strtoul (optarg, NULL, 10); break;
+		case 'f': fanout = strtoul (optarg, NULL, 10); break;
+		case 'd': depth = strtoul (optarg, NULL, 10); break;
+		case 'w': width = strtoul (optarg, NULL, 10); break;
+		case 't': disorder = strtol (optarg, NULL, 10); break;
+		case 'b': nlines = strtoul (optarg, NULL, 10); break;
+		case 's': rng = strtoull (optarg, NULL, 10); break;
+		case 'm':
+			if (strcmp (optarg, "seq") == 0)
+				pattern = SEQ;
+			else if (strcmp (optarg, "random") == 0)
+				pattern = RANDOM;
+			else if (strcmp (optarg, "prefix") == 0)
+				pattern = PREFIX;
+			else
+				argc = 0; // force usage message
+			break;
+		default: argc = 0; break; // force usage message
+		}
+	}
+	if (argc != optind || fanout < 1 || width < 1 || disorder < 0)
+		errx (EX_USAGE, "usage: %s [-n messages] [-f fanout] "
+			"[-d depth] [-w width] [-t disorder] [-b lines] "
+			"[-m seq|random|prefix] [-s seed]", argv[0]);
+	if (rng == 0)
+		rng = 2521; // xorshift state must be non-zero
+
+	// size of a full thread: 1 + F + F^2 + ... + F^D messages
+	// (but no more than the whole mailbox)
+	size_t threadSize = 1, level = 1;
+	for (size_t d = 0; d < depth && threadSize < nmesgs; d++) {
+		level *= fanout;
+		threadSize += level;
+	}
+	if (threadSize > nmesgs)
+		threadSize = nmesgs;
+
+	Thread *open = calloc (width, sizeof *open);
+	if (open == NULL) err (EX_OSERR, "couldn't allocate threads");
+	unsigned long nthreads = 0;
+	for (size_t i = 0; i < width; i++)
+		startThread (&open[i], nthreads++, threadSize);
+
+	for (unsigned long n = 0; n < nmesgs; n++) {
+		Thread *t = &open[nextRandom () % width];
+		if (t->next == t->size)
+			startThread (t, nthreads++, threadSize);
+		size_t k = t->next++;
+		if (k == t->max) {
+			t->max = (t->max == 0) ? 64 : 2 * t->max;
+			t->mesgs = realloc (t->mesgs, t->max * sizeof *t->mesgs);
+			if (t->mesgs == NULL) err (EX_OSERR, "couldn't allocate thread");
+		}
+		t->mesgs[k] = n;
+
+		// message k's parent is message (k-1)/F of its thread
+		time_t when = BASE_TIME + 60 * (time_t) n;
+		if (disorder > 0)
+			when += (time_t) (nextRandom () % (uint64_t) (2 * disorder + 1))
+				- disorder;
+		struct tm tm;
+		gmtime_r (&when, &tm);
+		char envelope[32], date[40];
+		strftime (envelope, sizeof envelope, "%a %b %e %H:%M:%S %Y", &tm);
+		strftime (date, sizeof date, "%a, %d %b %Y %H:%M:%S +0000", &tm);
+		unsigned user = (unsigned) (nextRandom () % 100);
+
+		printf ("From user%u@bench.example %s\n", user, envelope);
+		printf ("From: User %u <user%u@bench.example>\n", user, user);
+		printf ("Subject: %sThread %lu\n", (k == 0) ? "" : "Re: ", t->id);
+		printf ("Date: %s\n", date);
+		printf ("Message-ID: ");
+		showID (pattern, n);
+		if (k > 0) {
+			printf ("In-Reply-To: ");
+			showID (pattern, t->mesgs[(k - 1) / fanout]);
+		}
+		printf ("\n");
+		for (size_t l = 0; l < nlines; l++)
+			printf ("Line %zu of message %lu, in thread %lu.\n",
+				l + 1, n, t->id);
+		printf ("\n");
+	}
+
+	for (size_t i = 0; i < width; i++)
+		free (open[i].mesgs);
+	free (open);
+	return EXIT_SUCCESS;
+}
+
+// next number from xorshift64* generator
+static uint64_t nextRandom (void)
+{
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+	return rng * 2685821657736338717ULL;
+}
+
+// print Message-ID of message n (and a newline)
+// - seq:    IDs increase with n (worst case for an unbalanced tree)
+// - random: IDs in no particular order
+// - prefix: all IDs share a long prefix (costly string compares)
+static void showID (IDPattern pattern, unsigned long n)
+{
+	switch (pattern) {
+	case SEQ:
+		printf ("<%010lu@bench.example>\n", n);
+		break;
+	case RANDOM:
+		// a fixed bijection of n, so IDs stay unique
+		printf ("<%016llx@bench.example>\n", (unsigned long long)
+			((n + 1) * 11400714819323198485ULL));
+		break;
+	case PREFIX:
+		printf ("<CAH+bench.example.thread.prefix.20190201.%010lu"
+			"@mail.bench.example>\n", n);
+		break;
+	}
+}
+
+// (re)start an open thread slot with a new, empty thread
+static void startThread (Thread *t, unsigned long id, size_t size)
+{
+	t->id = id;
+	t->next = 0;
+	t->size = size;
+}
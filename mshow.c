@@ -0,0 +1,100 @@
+// mshow.c ... show the messages of a mailbox, in mailbox order
+// Reads one message at a time, with MailBoxNext (or, with -f, with
+// getMailMessage from an open file), and formats each one into a
+// buffer with showMailMessageTo; so it shows the same messages as
+// task1, but as they come, without building an MMList.
+// -b also shows how long each message's body is (MailMessageBody;
+// getMailMessage doesn't keep bodies, so -f shows them all as empty).
+// -t instead threads each message as it is read (ThreadTreeAdd), and
+// shows the thread tree at the end; whatever order the messages are
+// in, this is the tree that task3 shows.
+
+#include <err.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sysexits.h>
+#include <unistd.h>
+
+#include "MailBox.h"
+#include "MailMessage.h"
+#include "ThreadTree.h"
+
+static void show (MailMessage mesg, bool showBody);
+
+int main (int argc, char *argv[])
+{
+	// Process command line args
+	// -f reads the mailbox through stdio (getMailMessage)
+	// -b shows the length of each message's body
+	// -t threads the messages as they are read, and shows the threads
+	bool useFile = false;               // read with getMailMessage?
+	bool showBody = false;              // show body lengths?
+	bool threaded = false;              // show thread tree?
+	int opt;
+	while ((opt = getopt (argc, argv, "fbt")) != -1) {
+		if (opt == 'f')
+			useFile = true;
+		else if (opt == 'b')
+			showBody = true;
+		else if (opt == 't')
+			threaded = true;
+		else
+			argc = 0; // force usage message
+	}
+	if (argc - optind != 1 || (useFile && threaded))
+		errx (EX_USAGE, "usage: %s [-f] [-b] <mailbox>\n"
+			"       %s -t <mailbox>", argv[0], argv[0]);
+	char *mailbox = argv[optind];
+
+	MailMessage msg;                    // current mail message
+	if (useFile) {
+		FILE *in = fopen (mailbox, "r");
+		if (in == NULL)
+			err (EX_DATAERR, "can't open %s", mailbox);
+		while ((msg = getMailMessage (in)) != NULL) {
+			show (msg, showBody);
+			dropMailMessage (msg);
+		}
+		fclose (in);
+	} else {
+		MailBox in = newMailBox (mailbox);
+		if (in == NULL)
+			err (EX_DATAERR, "can't open %s", mailbox);
+		// (the ThreadTree lives in the mailbox's Arena, like its
+		// messages, and goes with it)
+		ThreadTree threads = newThreadTreeIn (MailBoxArena (in));
+		while ((msg = MailBoxNext (in)) != NULL) {
+			if (threaded)
+				ThreadTreeAdd (threads, msg);
+			else
+				show (msg, showBody);
+		}
+		if (threaded)
+			showThreadTree (threads);
+		dropMailBox (in);
+	}
+	return EXIT_SUCCESS;
+}
+
+// write one message to stdout, as task1 does, and its body length
+static void show (MailMessage mesg, bool showBody)
+{
+	char local[1024];
+	char *buf = local;
+	size_t len = (size_t) showMailMessageTo (local, sizeof local, mesg, 0);
+	if (len >= sizeof local) {
+		buf = malloc (len + 1);
+		if (buf == NULL) err (EX_OSERR, "couldn't allocate message text");
+		showMailMessageTo (buf, len + 1, mesg, 0);
+	}
+	fwrite (buf, 1, len, stdout);
+	if (buf != local)
+		free (buf);
+
+	if (showBody) {
+		size_t bodyLen;
+		MailMessageBody (mesg, &bodyLen);
+		printf ("  body: %zu bytes\n", bodyLen);
+	}
+}
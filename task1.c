@@ -5,44 +5,52 @@
 #include <stdlib.h>
 #include <sysexits.h>
 
+#include "Arena.h"
+#include "MailBox.h"
 #include "MMList.h"
 #include "MailMessage.h"
+#include "Options.h"
+#include "Stats.h"
 
 
 
 int main (int argc, char *argv[])
 {
-	// Process command line args
-	if (argc != 2)
-		errx (EX_USAGE, "usage: %s <mailbox>", argv[0]);
-	char *mailbox = argv[1];
-
-	// Open input file
-	FILE *in;                           // input file handle
-	if ((in = fopen (mailbox, "r")) == NULL)
-		err (EX_DATAERR, "can't open %s", mailbox);
-
-	// Read messages and store in MMList and MMTree
-	MMList msgList = newMMList ();      // list of all messages read
+	// Process command line args (see Options.h)
+	Options opts = parseOptions (argc, argv, false);
+
+	// Open (and map) input file
+	StatsPhase ("parse");
+	MailBox in;                         // input mailbox
+	if ((in = newMailBox (opts.mailbox)) == NULL)
+		err (EX_DATAERR, "can't open %s", opts.mailbox);
+	if (opts.useIndex)
+		MailBoxUseIndex (in, NULL);
+
+	// Read messages and store in MMList
+	Arena mem = MailBoxArena (in);      // memory for everything below
+	MMList msgList = newMMListIn (mem); // list of all messages read
 	MailMessage msg;                    // current mail message
-	while ((msg = getMailMessage (in)) != NULL) {
-		
-		//printf("INSERTING\n");
-		MMListInsert (msgList, msg);
-		//showMMList(msgList);
+	size_t nmsgs;                       // number of messages read
+	MailMessage *msgs = MailBoxReadAll (in, opts.nthreads, &nmsgs);
+	StatsPhase ("list");
+	for (size_t i = 0; i < nmsgs; i++) {
+		msg = msgs[i];
+		MMListAppendUnordered (msgList, msg);
 	}
+	free (msgs);
+	MMListFinalize (msgList);
 
+	StatsPhase ("show");
 	printf ("\n=== List ===\n");
 	showMMList (msgList);
+	StatsPhase (NULL);
 
-	// Drop data structures.  We must do so carefully, as ThreadTree,
-	// MMTree, and MMList can all hold references to a MailMessage, and
-	// none of their destructors deallocate MailMessages.
-
-	MMListStart (msgList);
-	while ((msg = MMListNext (msgList)) != NULL)
-		dropMailMessage (msg);
-	dropMMList (msgList);
+	// Drop data structures.  The MailMessages and the MMList were
+	// allocated from the mailbox's Arena, so dropping the mailbox
+	// releases everything in one go.
+	dropMailBox (in);
 
+	StatsReport (stderr);
 	return EXIT_SUCCESS;
 }
@@ -5,43 +5,56 @@
 #include <stdlib.h>
 #include <sysexits.h>
 
+#include "Arena.h"
+#include "MailBox.h"
 #include "MMList.h"
 #include "MMTree.h"
 #include "MailMessage.h"
+#include "Options.h"
+#include "Stats.h"
 
 int main (int argc, char *argv[])
 {
-	// Process command line args
-	if (argc != 2)
-		errx (EX_USAGE, "usage: %s <mailbox>", argv[0]);
-	char *mailbox = argv[1];
+	// Process command line args (see Options.h)
+	Options opts = parseOptions (argc, argv, false);
 
-	// Open input file
-	FILE *in;                           // input file handle
-	if ((in = fopen (mailbox, "r")) == NULL)
-		err (EX_DATAERR, "can't open %s", mailbox);
+	// Open (and map) input file
+	StatsPhase ("parse");
+	MailBox in;                         // input mailbox
+	if ((in = newMailBox (opts.mailbox)) == NULL)
+		err (EX_DATAERR, "can't open %s", opts.mailbox);
+	if (opts.useIndex)
+		MailBoxUseIndex (in, NULL);
 
 	// Read messages and store in MMList and MMTree
-	MMList msgList = newMMList ();      // list of all messages read
-	MMTree msgIDs = newMMTree ();       // search tree of Message-ID's
+	Arena mem = MailBoxArena (in);      // memory for everything below
+	MMList msgList = newMMListIn (mem); // list of all messages read
+	MMTree msgIDs = newMMTreeIn (mem);  // search tree of Message-ID's
 	MailMessage msg;                    // current mail message
-	while ((msg = getMailMessage (in)) != NULL) {
-		MMListInsert (msgList, msg);
+	size_t nmsgs;                       // number of messages read
+	MailMessage *msgs = MailBoxReadAll (in, opts.nthreads, &nmsgs);
+	StatsPhase ("list");
+	for (size_t i = 0; i < nmsgs; i++)
+		MMListAppendUnordered (msgList, msgs[i]);
+	MMListFinalize (msgList);
+	StatsPhase ("tree");
+	for (size_t i = 0; i < nmsgs; i++) {
+		msg = msgs[i];
 		MMTreeInsert (msgIDs, MailMessageID (msg), msg);
 	}
+	free (msgs);
+	StatsSet (ST_TREE_DEPTH, (unsigned long long) MMTreeDepth (msgIDs));
 
+	StatsPhase ("show");
 	printf ("\n=== Tree ===\n");
 	showMMTree (msgIDs);
+	StatsPhase (NULL);
 
-	// Drop data structures.  We must do so carefully, as ThreadTree,
-	// MMTree, and MMList can all hold references to a MailMessage, and
-	// none of their destructors deallocate MailMessages.
-	dropMMTree (msgIDs);
-
-	MMListStart (msgList);
-	while ((msg = MMListNext (msgList)) != NULL)
-		dropMailMessage (msg);
-	dropMMList (msgList);
+	// Drop data structures.  MailMessages, MMList and MMTree were
+	// all allocated from the mailbox's Arena, so dropping the mailbox
+	// releases everything in one go.
+	dropMailBox (in);
 
+	StatsReport (stderr);
 	return EXIT_SUCCESS;
 }
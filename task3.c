@@ -5,49 +5,59 @@
 #include <stdlib.h>
 #include <sysexits.h>
 
+#include "Arena.h"
+#include "MailBox.h"
 #include "MMList.h"
-#include "MMTree.h"
 #include "MailMessage.h"
+#include "Options.h"
+#include "Stats.h"
 #include "ThreadTree.h"
 
 int main (int argc, char *argv[])
 {
-	// Process command line args
-	if (argc != 2)
-		errx (EX_USAGE, "usage: %s <mailbox>", argv[0]);
-	char *mailbox = argv[1];
-
-	// Open input file
-	FILE *in;                           // input file handle
-	if ((in = fopen (mailbox, "r")) == NULL)
-		err (EX_DATAERR, "can't open %s", mailbox);
-
-	// Read messages and store in MMList and MMTree
-	MMList msgList = newMMList ();      // list of all messages read
-	MMTree msgIDs = newMMTree ();       // search tree of Message-ID's
+	// Process command line args (see Options.h)
+	Options opts = parseOptions (argc, argv, true);
+
+	// Open (and map) input file
+	StatsPhase ("parse");
+	MailBox in;                         // input mailbox
+	if ((in = newMailBox (opts.mailbox)) == NULL)
+		err (EX_DATAERR, "can't open %s", opts.mailbox);
+	if (opts.useIndex)
+		MailBoxUseIndex (in, NULL);
+
+	// Read messages and store in MMList
+	Arena mem = MailBoxArena (in);      // memory for everything below
+	MMList msgList = newMMListIn (mem); // list of all messages read
 	MailMessage msg;                    // current mail message
-	while ((msg = getMailMessage (in)) != NULL) {
-		MMListInsert (msgList, msg);
-		MMTreeInsert (msgIDs, MailMessageID (msg), msg);
+	size_t nmsgs;                       // number of messages read
+	MailMessage *msgs = MailBoxReadAll (in, opts.nthreads, &nmsgs);
+	StatsPhase ("list");
+	for (size_t i = 0; i < nmsgs; i++) {
+		msg = msgs[i];
+		MMListAppendUnordered (msgList, msg);
 	}
+	free (msgs);
+	MMListFinalize (msgList);
 
-	// Build thread tree from msgList and msgIDs
+	// Build thread tree from msgList
 	// Assumes that messages in mgsList are in timestamp order
-	ThreadTree threads = ThreadTreeBuild (msgList, msgIDs);
+	// (the ThreadTree indexes Message-ID's itself, so no MMTree)
+	StatsPhase ("threads");
+	ThreadTree threads = opts.useRefs ?
+		ThreadTreeBuildRefsIn (msgList, MailBoxIDs (in), mem) :
+		ThreadTreeBuildIn (msgList, NULL, mem);
 
 	// Display thread tree
+	StatsPhase ("show");
 	showThreadTree (threads);
+	StatsPhase (NULL);
 
-	// Drop data structures.  We must do so carefully, as ThreadTree,
-	// MMTree, and MMList can all hold references to a MailMessage, and
-	// none of their destructors deallocate MailMessages.
-	dropThreadTree (threads);
-	dropMMTree (msgIDs);
-
-	MMListStart (msgList);
-	while ((msg = MMListNext (msgList)) != NULL)
-		dropMailMessage (msg);
-	dropMMList (msgList);
+	// Drop data structures.  MailMessages, MMList and ThreadTree were
+	// all allocated from the mailbox's Arena, so dropping the mailbox
+	// releases everything in one go.
+	dropMailBox (in);
 
+	StatsReport (stderr);
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,12 @@
+# an empty mailbox has no messages (and nothing to index)
+out=$(mktemp)
+cp tests/Empty $out
+./task1 $out
+./task2 $out
+./task3 $out
+./task3 -r $out
+./task1 -i -j 4 $out
+./mshow $out
+./mshow -f $out
+ls $out.idx 2>/dev/null
+rm -f $out $out.idx
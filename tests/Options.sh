@@ -0,0 +1,9 @@
+# the task programs share their options; only task3 takes -r
+./task1 2>&1
+./task1 -r tests/Simple 2>&1
+./task2 -x tests/Simple 2>&1
+./task3 tests/Simple tests/Workshop 2>&1
+./task3 -r -j 2 tests/Simple | cmp - tests/task3_Simple.exp &&
+	echo "task3 -r -j 2 gives the same output"
+./task2 --stats -j 2 tests/Workshop 2>&1 >/dev/null |
+	grep -o '"messages": {[^}]*}'
@@ -0,0 +1 @@
+./mshow -b tests/Simple | grep body:
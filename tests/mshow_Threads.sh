@@ -0,0 +1,40 @@
+# threading messages one at a time as they arrive (ThreadTreeAdd) must
+# give task3's tree (ThreadTreeBuild) even when the messages come in a
+# shuffled order, with many replies before the messages they answer;
+# and, with every timestamp the same, it must order them as MMList does
+out=$(mktemp)
+awk '/^From /{ n++ } { m[n] = m[n] $0 "\n" }
+	END { for (i = 0; i < n; i++) printf "%s", m[(i * 17) % n + 1] }' \
+	tests/Workshop > $out
+./task3 tests/Workshop > $out.build
+./mshow -t tests/Workshop | cmp - $out.build &&
+	echo "ThreadTreeAdd gives the same tree as ThreadTreeBuild"
+./mshow -t $out | cmp - $out.build &&
+	echo "ThreadTreeAdd on a shuffled mailbox gives the same tree"
+cmp -s $out tests/Workshop || echo "(the shuffled mailbox is in another order)"
+wc -l < $out.build
+
+sed 's/^Date: .*/Date: Mon, 4 Mar 2019 12:00:00 +1100/' tests/Workshop > $out
+./task3 $out > $out.build
+./mshow -t $out | cmp - $out.build &&
+	echo "with all timestamps the same, ThreadTreeAdd gives the same tree"
+grep '^| M-ID' $out.build > $out.top
+./task1 $out | grep -F -x -f $out.top | cmp - $out.top &&
+	echo "and its threads are in MMList order"
+
+# a message replying to itself, and two with the same timestamp
+# replying to each other, must not be lost in a loop of replies
+msg () {
+	printf 'From test@example.org  Tue Feb 05 %s:00 2019\n' $1
+	printf 'From: Tester <test@example.org>\nSubject: %s\n' $2
+	printf 'Date: Tue, 5 Feb 2019 %s:00 +0000\n' $1
+	printf 'Message-ID: <%s@example.org>\n' $2
+	printf 'In-Reply-To: <%s@example.org>\n\nBody\n\n' $3
+}
+{ msg 09:00 self self; msg 10:00 one two; msg 10:00 two one;
+  msg 11:00 other none; } > $out
+# (which of the two is the reply depends on which arrives first)
+./task3 $out | grep -c 'M-ID'
+./mshow -t $out | grep -c 'M-ID'
+./task3 $out
+rm -f $out $out.build $out.top
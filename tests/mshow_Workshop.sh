@@ -0,0 +1,14 @@
+# messages read one at a time (with MailBoxNext, or getMailMessage for
+# -f) and shown with showMailMessageTo must be the ones task1 shows,
+# in mailbox order rather than sorted (so compare them sorted, with
+# each message's 7 lines pasted into one)
+out=$(mktemp)
+./task1 tests/Workshop | tail -n +3 | paste - - - - - - - | sort > $out.task1
+./mshow tests/Workshop > $out.next
+./mshow -f tests/Workshop > $out.file
+paste - - - - - - - < $out.next | sort | cmp - $out.task1 &&
+	echo "MailBoxNext gives the same messages as task1"
+cmp $out.next $out.file &&
+	echo "getMailMessage gives the same messages as MailBoxNext"
+wc -l < $out.next
+rm -f $out $out.task1 $out.next $out.file
@@ -0,0 +1,10 @@
+# lines over 1000 bytes (one with "From " in the middle), header
+# fields folded over two lines, and no newline at the end; getMailMessage
+# (mshow -f) must read the messages the same as the mapped reader
+./task1 tests/Folded
+out=$(mktemp)
+./mshow tests/Folded > $out
+./mshow -f tests/Folded | cmp - $out &&
+	echo "getMailMessage gives the same messages"
+./mshow -b tests/Folded | grep body:
+rm -f $out
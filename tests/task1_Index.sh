@@ -0,0 +1,21 @@
+# an index (-i) is written by the first run and used by the next ones,
+# and when mail is appended to the mailbox, only the new mail is
+# scanned and the index is brought up to date; the output must always
+# be what it would be without the index
+out=$(mktemp)
+cat tests/Simple > $out
+./task1 $out > $out.plain
+./task1 -i $out | cmp - $out.plain && echo "first run gives the same output"
+test -s $out.idx && echo "index written"
+./task1 -i -j 4 $out | cmp - $out.plain && echo "indexed run gives the same output"
+MAILBOX_STATS=1 ./task1 -i $out 2>&1 >/dev/null | grep -o '"messages": {[^}]*}'
+
+cat tests/Workshop >> $out
+./task1 $out > $out.plain
+MAILBOX_STATS=1 ./task1 -i $out 2>$out.stats | cmp - $out.plain &&
+	echo "after appending, the same output"
+grep -o '"messages": {[^}]*}' $out.stats
+MAILBOX_STATS=1 ./task1 -i -j 4 $out 2>$out.stats | cmp - $out.plain &&
+	echo "re-indexed run gives the same output"
+grep -o '"messages": {[^}]*}' $out.stats
+rm -f $out $out.idx $out.plain $out.stats
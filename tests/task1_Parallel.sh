@@ -0,0 +1,9 @@
+# a mailbox big enough to be split into several chunks (40 copies of
+# Workshop) must give the same output parsed on one thread or four
+big=$(mktemp)
+for i in $(seq 40); do cat tests/Workshop; done > $big
+./task1 -j 1 $big > $big.1
+./task1 -j 4 $big > $big.4
+cmp $big.1 $big.4 && echo "-j 1 and -j 4 give the same output"
+wc -l < $big.1
+rm -f $big $big.1 $big.4
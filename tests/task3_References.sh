@@ -0,0 +1,4 @@
+# References threading: a missing message with several replies gets a
+# placeholder, one with a single reply is left out, loops are broken,
+# and comments in References are ignored
+./task3 -r tests/References